@@ -0,0 +1,427 @@
+"""
+Turret style tool changer driven by stepper motor
+
+Author: Peter van Tol <petertgvantol@gmail.com>
+License: GPL Version 2
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of version 2 of the GNU General
+Public License as published by the Free Software Foundation.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+THE AUTHORS OF THIS LIBRARY ACCEPT ABSOLUTELY NO LIABILITY FOR
+ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE
+TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of
+harming persons must have provisions for completely removing power
+from all motors, etc, before persons enter any danger area.  All
+machinery must be designed to comply with local and national safety
+codes, and the authors of this software can not, and do not, take
+any responsibility for such compliance.
+
+This code was written as part of the LiteX-CNC project.
+
+Copyright (c) 2023 All rights reserved.
+"""
+# Imports for creating the layout of the registers
+import json
+import zlib
+from enum import IntEnum, auto
+from pathlib import Path
+from typing import List, NamedTuple
+
+# The generated header is shipped with the driver, see generate_header()
+LAYOUT_HEADER = Path(__file__).parent.parent / 'driver' / 'litexcnc_toolerator_layout.h'
+
+
+class TooleratorStates(IntEnum):
+    """Different states of the Toolerator. One could use the Migen FSM module, however
+    this statement is rendered as combinatorial. This poses issues with the stepgen, where
+    any change in target_position takes a clock-cycle to be effective. With combinatorial
+    statements parts are skipped when the states are changed.
+    """
+    START = auto()
+    HOME_SEARCHING = auto()
+    HOME_BACK_OFF = auto()
+    HOME_LATCHING = auto()
+    HOME_MOVE_TO_ZERO = auto()
+    MOVING_FORWARD = auto()
+    MOVING_BACKWARD = auto()
+    READY = auto()
+    ERROR = auto()
+    TUNING = auto()
+    SEQUENCING = auto()
+    MOVING_REVERSE = auto()
+
+
+class LayoutField(NamedTuple):
+    """A field within a 32-bit register."""
+    name: str
+    size: int
+    offset: int
+    description: str
+
+
+class LayoutRegister(NamedTuple):
+    """A 32-bit register exchanged with the driver. A register without fields holds a
+    single 32-bit value. The description may refer to the index of the instance with
+    `{index}`.
+    """
+    name: str
+    description: str
+    fields: List[LayoutField] = None
+
+
+# Registers written once by the driver in the first cycle
+CONFIG_REGISTERS = [
+    LayoutRegister(
+        'restore',
+        "Toolerator restore data"
+        "Position restored from the previous run for toolerator {index}.",
+        [
+            LayoutField("tool_number", 16, 0, "The pocket the turret was locked at in the previous run."),
+            LayoutField("valid", 1, 16, "A rising edge restores the pocket when the turret has no reference."),
+        ]
+    ),
+]
+
+# Registers written every cycle by the driver
+WRITE_REGISTERS = [
+    LayoutRegister(
+        'data',
+        "Toolerator write data"
+        "Toolchange data for toolerator {index}.",
+        [
+            LayoutField("tool_number", 8, 0, "The requested tool."),
+            LayoutField("tool_change", 1, 8, "Indication that tool change is requested."),
+            LayoutField("enabled", 1, 16, "Indication that toolchanger is enabled."),
+            LayoutField("home", 1, 24, "A rising edge requests the toolchanger to home."),
+        ]
+    ),
+    LayoutRegister(
+        'queue_data',
+        "Toolerator queue write data"
+        "Command queue data for toolerator {index}.",
+        [
+            LayoutField("tool_number", 8, 0, "The tool to be added to the queue."),
+            LayoutField("push", 1, 8, "Each toggle of this bit adds the tool to the queue."),
+            LayoutField("clear", 1, 16, "Discards all queued tools while set."),
+        ]
+    ),
+    LayoutRegister(
+        'tune_data',
+        "Toolerator tune write data"
+        "Tuning data for toolerator {index}.",
+        [
+            LayoutField("tune", 1, 0, "A rising edge starts tuning of the speed and acceleration."),
+            LayoutField("scope_arm", 1, 8, "A rising edge arms the capture of the trajectory."),
+        ]
+    ),
+    LayoutRegister(
+        'table_data',
+        "Toolerator table write data"
+        "Tool table data for toolerator {index} (carousel mode only).",
+        [
+            LayoutField("tool", 8, 0, "The tool ID of the entry in the tool table."),
+            LayoutField("pocket", 8, 8, "The pocket of the tool."),
+            LayoutField("write", 1, 16, "Each toggle of this bit writes the entry to the tool table."),
+        ]
+    ),
+]
+
+# Registers written every cycle by the driver, only for instances with 16-bit tool numbers
+WRITE_HIGH_REGISTERS = [
+    LayoutRegister(
+        'data_high',
+        "Toolerator wide write data"
+        "Upper bytes of the tool numbers for toolerator {index} (16-bit tool numbers only).",
+        [
+            LayoutField("tool_number", 8, 0, "Upper byte of the requested tool."),
+            LayoutField("queue_tool_number", 8, 8, "Upper byte of the tool to be added to the queue."),
+            LayoutField("table_tool", 8, 16, "Upper byte of the tool ID of the entry in the tool table."),
+            LayoutField("table_pocket", 8, 24, "Upper byte of the pocket of the tool."),
+        ]
+    ),
+]
+
+# Registers written every cycle by the driver, only for instances with a log of state
+# transitions
+WRITE_EVENT_REGISTERS = [
+    LayoutRegister(
+        'event_data',
+        "Toolerator event write data"
+        "Index of the first state transition to be read from toolerator {index}.",
+        [
+            LayoutField("read", 16, 0, "The number of state transitions read by the driver."),
+        ]
+    ),
+]
+
+# Registers read every cycle by the driver
+READ_REGISTERS = [
+    LayoutRegister(
+        'status',
+        "toolerator instance status"
+        "Status of the toolerator {index}.",
+        [
+            LayoutField("status", 4, 0, "Tool changer status."),
+            LayoutField("homed", 1, 8, "Tool changer has been homed."),
+            LayoutField("tool_number", 8, 16, "The current selected tool."),
+            LayoutField("moving_to_tool", 8, 24, "The tool the toolchanger is moving to."),
+        ]
+    ),
+    LayoutRegister(
+        'queue_status',
+        "toolerator queue status"
+        "Status of the command queue of toolerator {index}.",
+        [
+            LayoutField("level", 8, 0, "Number of tools waiting in the queue."),
+            LayoutField("full", 1, 8, "The queue cannot accept more tools."),
+        ]
+    ),
+    LayoutRegister(
+        'position',
+        "toolerator position"
+        "Position (in steps) of the stepgen of toolerator {index}."
+    ),
+    LayoutRegister(
+        'position_fb',
+        "toolerator position feedback"
+        "Position (in steps) measured by the encoder of toolerator {index}. Equal "
+        "to the position of the stepgen when no encoder is present."
+    ),
+    LayoutRegister(
+        'drift',
+        "toolerator drift"
+        "Difference (in steps) between the home switch found at the last pass and "
+        "the reference of toolerator {index}."
+    ),
+    LayoutRegister(
+        'tune_status',
+        "toolerator tune status"
+        "Result of the tuning of toolerator {index}.",
+        [
+            LayoutField("passed", 8, 0, "The number of trial revolutions passed during tuning."),
+        ]
+    ),
+    LayoutRegister(
+        'tune_max_vel',
+        "toolerator tuned speed"
+        "Speed (in steps per second) of the last passed trial of toolerator {index}."
+    ),
+    LayoutRegister(
+        'tune_max_acc',
+        "toolerator tuned acceleration"
+        "Acceleration (in steps per second squared) of the last passed trial of toolerator {index}."
+    ),
+]
+
+# Registers read every cycle by the driver, only for instances with 16-bit tool numbers
+READ_HIGH_REGISTERS = [
+    LayoutRegister(
+        'status_high',
+        "toolerator wide status"
+        "Upper bytes of the tool numbers of toolerator {index} (16-bit tool numbers only).",
+        [
+            LayoutField("tool_number", 8, 0, "Upper byte of the current selected tool."),
+            LayoutField("moving_to_tool", 8, 8, "Upper byte of the tool the toolchanger is moving to."),
+        ]
+    ),
+]
+
+# The number of state transitions read by the driver each cycle
+EVENTS_PER_CYCLE = 4
+
+# Registers read every cycle by the driver, only for instances with a log of state
+# transitions. The time is expressed in micro-seconds since the FPGA has started. Only the
+# lower 32 bits of the time of each transition are stored; the upper bits follow from the
+# current time.
+READ_EVENT_REGISTERS = [
+    LayoutRegister(
+        'event_status',
+        "toolerator event status"
+        "Status of the log of state transitions of toolerator {index}.",
+        [
+            LayoutField("write", 16, 0, "The number of state transitions recorded."),
+            LayoutField("read", 16, 16, "The index of the first state transition in this data."),
+        ]
+    ),
+    LayoutRegister(
+        'event_time_high',
+        "toolerator time"
+        "Upper 32 bits of the current time (in micro-seconds) of toolerator {index}."
+    ),
+    LayoutRegister(
+        'event_time_low',
+        "toolerator time"
+        "Lower 32 bits of the current time (in micro-seconds) of toolerator {index}."
+    ),
+]
+
+# Registers of a single state transition, which follow the READ_EVENT_REGISTERS for each
+# of the EVENTS_PER_CYCLE transitions. The names are prefixed with `event_{event}_`.
+EVENT_REGISTERS = [
+    LayoutRegister(
+        'state',
+        "toolerator event state"
+        "State entered at transition {event} of toolerator {index}.",
+        [
+            LayoutField("state", 4, 0, "The state entered."),
+        ]
+    ),
+    LayoutRegister(
+        'time',
+        "toolerator event time"
+        "Lower 32 bits of the time (in micro-seconds) of transition {event} of toolerator {index}."
+    ),
+    LayoutRegister(
+        'position',
+        "toolerator event position"
+        "Position (in steps) of the stepgen at transition {event} of toolerator {index}."
+    ),
+]
+
+# The data-packages exchanged with the driver, in the order of the MMIO definition
+LAYOUT = {
+    'config_data': CONFIG_REGISTERS,
+    'write_data': WRITE_REGISTERS,
+    'write_data_high': WRITE_HIGH_REGISTERS,
+    'write_data_events': WRITE_EVENT_REGISTERS,
+    'read_data': READ_REGISTERS,
+    'read_data_high': READ_HIGH_REGISTERS,
+    'read_data_events': READ_EVENT_REGISTERS,
+}
+
+
+def layout_hash() -> int:
+    """Returns a checksum of the layout of the registers and the values of the states.
+    The checksum is stored in the config block and compared by the driver, so firmware
+    and driver with a different layout are not used together.
+    """
+    layout = {
+        'states': {state.name: state.value for state in TooleratorStates},
+        'events_per_cycle': EVENTS_PER_CYCLE,
+        'event': [
+            [register.name, [[field.name, field.size, field.offset] for field in register.fields or []]]
+            for register in EVENT_REGISTERS
+        ],
+        'registers': {
+            package: [
+                [register.name, [[field.name, field.size, field.offset] for field in register.fields or []]]
+                for register in registers
+            ]
+            for package, registers in LAYOUT.items()
+        }
+    }
+    return zlib.crc32(json.dumps(layout, sort_keys=True).encode())
+
+
+def generate_header() -> str:
+    """Returns the C header with the layout of the registers, which is included by the
+    driver. Each data-package is a struct of 32-bit (big-endian) words, one per register.
+    The fields are extracted using the generated masks and shifts.
+    """
+    lines = [
+        "/********************************************************************",
+        "* Description:  litexcnc_toolerator_layout.h",
+        "*               Layout of the registers of the toolerator",
+        "*",
+        "* Generated by litexcnc_toolerator.config.layout, do not edit. Run",
+        "* python -m litexcnc_toolerator.config.layout --write after changing",
+        "* the layout.",
+        "********************************************************************/",
+        "#ifndef __INCLUDE_LITEXCNC_TOOLERATOR_LAYOUT_H__",
+        "#define __INCLUDE_LITEXCNC_TOOLERATOR_LAYOUT_H__",
+        "",
+        "/** Checksum of the layout, must be equal to the checksum in the config block */",
+        f"#define LITEXCNC_TOOLERATOR_LAYOUT_HASH 0x{layout_hash():08X}",
+        "",
+        "/** The states of the toolerator */",
+    ]
+    for state in TooleratorStates:
+        lines.append(f"#define LITEXCNC_TOOLERATOR_STATE_{state.name} 0x{state.value:02X}")
+    lines += [
+        "/** The number of values the status field can hold */",
+        f"#define LITEXCNC_TOOLERATOR_STATE_COUNT {1 << READ_REGISTERS[0].fields[0].size}",
+        "",
+        "/** The number of state transitions read each cycle */",
+        f"#define LITEXCNC_TOOLERATOR_EVENTS_PER_CYCLE {EVENTS_PER_CYCLE}",
+        "",
+        "/** Packs a value in the given field of a register (host byte order) */",
+        "#define LITEXCNC_TOOLERATOR_PACK(field, value) \\",
+        "    ((((uint32_t) (value)) << LITEXCNC_TOOLERATOR_##field##_SHIFT) & LITEXCNC_TOOLERATOR_##field##_MASK)",
+        "/** Extracts the given field from a register (host byte order) */",
+        "#define LITEXCNC_TOOLERATOR_UNPACK(field, word) \\",
+        "    ((((uint32_t) (word)) & LITEXCNC_TOOLERATOR_##field##_MASK) >> LITEXCNC_TOOLERATOR_##field##_SHIFT)",
+    ]
+    for package, registers in LAYOUT.items():
+        lines += ["", f"/** Fields of the {package.replace('_', ' ')} registers */"]
+        for register in registers:
+            for field in register.fields or []:
+                name = f"LITEXCNC_TOOLERATOR_{register.name.upper()}_{field.name.upper()}"
+                lines.append(f"#define {name}_SHIFT {field.offset}")
+                lines.append(f"#define {name}_MASK 0x{((1 << field.size) - 1) << field.offset:08X}u")
+    lines += ["", "/** Fields of the registers of a single state transition */"]
+    for register in EVENT_REGISTERS:
+        for field in register.fields or []:
+            name = f"LITEXCNC_TOOLERATOR_EVENT_{register.name.upper()}_{field.name.upper()}"
+            lines.append(f"#define {name}_SHIFT {field.offset}")
+            lines.append(f"#define {name}_MASK 0x{((1 << field.size) - 1) << field.offset:08X}u")
+    lines += [
+        "",
+        "/** Data-package with a single state transition */",
+        "#pragma pack(push, 4)",
+        "typedef struct {",
+    ]
+    for register in EVENT_REGISTERS:
+        lines.append(f"    uint32_t {register.name};")
+    lines += [
+        "} litexcnc_toolerator_event_data_t;",
+        "#pragma pack(pop)",
+    ]
+    for package, registers in LAYOUT.items():
+        lines += [
+            "",
+            f"/** Data-package with the {package.replace('_', ' ')} of a single instance */",
+            "#pragma pack(push, 4)",
+            "typedef struct {",
+        ]
+        for register in registers:
+            lines.append(f"    uint32_t {register.name};")
+        if registers is READ_EVENT_REGISTERS:
+            lines.append("    litexcnc_toolerator_event_data_t event[LITEXCNC_TOOLERATOR_EVENTS_PER_CYCLE];")
+        lines += [
+            f"}} litexcnc_toolerator_instance_{package}_t;",
+            "#pragma pack(pop)",
+        ]
+    lines += ["", "#endif", ""]
+    return "\n".join(lines)
+
+
+def layout_header_outdated() -> bool:
+    """Returns True when the header shipped with the driver does not match the layout."""
+    return not LAYOUT_HEADER.exists() or LAYOUT_HEADER.read_text() != generate_header()
+
+
+if __name__ == "__main__":
+    # Without arguments the header is printed
+    import argparse
+    import sys
+    parser = argparse.ArgumentParser(description="Generates the layout header of the driver.")
+    group = parser.add_mutually_exclusive_group()
+    group.add_argument('--write', action='store_true', help="Update the header shipped with the driver.")
+    group.add_argument('--check', action='store_true', help="Fail when the header shipped with the driver is outdated.")
+    args = parser.parse_args()
+    if args.write:
+        LAYOUT_HEADER.write_text(generate_header())
+    elif args.check:
+        if layout_header_outdated():
+            sys.exit(f"{LAYOUT_HEADER} is outdated, update it with --write.")
+    else:
+        print(generate_header(), end="")
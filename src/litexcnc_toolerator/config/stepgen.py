@@ -73,6 +73,11 @@ class StepgenConfig(BaseModel):
     speed: StepgenSpeed = Field(
         ...
     )
+    lock_speed: StepgenSpeed = Field(
+        None,
+        description="The maximum speed and acceleration for the move back into the ratchet "
+        "to lock the tool changer. When not defined, `speed` is used for this move as well."
+    )
     timings: StepgenTimings = Field(
         ...
     )
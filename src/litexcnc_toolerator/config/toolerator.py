@@ -31,6 +31,7 @@ Copyright (c) 2023 All rights reserved.
 """
 # Imports for creating a json-definition
 import os
+import zlib
 from enum import IntEnum, auto
 try:
     from typing import ClassVar, Iterable, List, Literal, Union
@@ -44,6 +45,7 @@ from pydantic import Field, conlist
 from litexcnc.config.modules import ModuleBaseModel, ModuleInstanceBaseModel
 
 # Local imports
+from litexcnc_toolerator.config.layout import layout_hash, layout_header_outdated
 from litexcnc_toolerator.config.stepgen import StepgenConfig
 
 class TooleratorHomingConfig(ModuleInstanceBaseModel):
@@ -57,15 +59,30 @@ class TooleratorHomingConfig(ModuleInstanceBaseModel):
         None,
         description="Inverts the homing pin. When set to True, the homing pin is active LOW."
     )
+    home_debounce: float = Field(
+        0,
+        ge=0,
+        description="The time (in microseconds) the homing pin must be stable before a change "
+        "is accepted. This filters out glitches on noisy inputs. The delay introduced by the "
+        "filter is compensated for in the captured home position."
+    )
     home_back_off: float = Field(
         None,
         description="The distance (in degerees) the toolchanger should back off from the switch. "
         "When not defined, the value of over-travel is used."
     )
     home_latch_vel: float = Field(
-        ...,
+        None,
         description="Specifies the speed and direction that LitexCNC uses when it makes its final "
-        "accurate determination of the home switch (if present)."
+        "accurate determination of the home switch (if present). The position is captured in "
+        "hardware on the edge of the home switch, which gives a repeatable reference at full "
+        "speed. When not defined, the latching pass is skipped and the turret is homed in a "
+        "single pass at full speed."
+    )
+    home_edge: Literal['rising', 'center'] = Field(
+        'rising',
+        description="The edge of the home switch used as reference. With 'center' the position "
+        "is captured on both edges and the center of the switch is used as reference."
     )
     home_position: float = Field(
         None,
@@ -74,6 +91,213 @@ class TooleratorHomingConfig(ModuleInstanceBaseModel):
         "the turret will move back again). When the position is negative over travel is NOT taken "
         "into account, as the turret is already moving backwards to it locking position."
     )
+    home_on_enable: bool = Field(
+        False,
+        description="When set to True, the turret starts homing as soon as it is enabled, so it "
+        "can be homed in parallel with the axes of the machine. Otherwise the turret is homed when "
+        "requested with the `home` pin or at the first tool change."
+    )
+    max_drift: float = Field(
+        None,
+        description="The maximum difference (in degrees) between the position of the home switch "
+        "found during a tool change and the position found during homing. The position is checked "
+        "every time the turret passes the home switch. When exceeded, steps have been missed and "
+        "the turret is stopped, loses its reference and enters the ERROR state. When not defined, "
+        "the difference is only reported."
+    )
+    verify_restore: bool = Field(
+        False,
+        description="When set to True, a pocket restored from the previous run is confirmed by "
+        "a single pass over the home switch when the turret is enabled. The turret ends at the "
+        "first tool, as after homing. When the home switch is not found where expected, the "
+        "toolerator enters the ERROR state."
+    )
+
+
+class TooleratorPositionCodeConfig(ModuleInstanceBaseModel):
+    code_pins: conlist(item_type=str, min_items=1, max_items=8) = Field(
+        ...,
+        description="The pins on the FPGA-card for the coded position switches, least "
+        "significant bit first. These pins MUST be configured as input. When the turret "
+        "reports a valid pocket at start-up, it is considered homed and the homing sequence "
+        "is not required."
+    )
+    encoding: Literal['binary', 'gray'] = Field(
+        'binary',
+        description="The encoding of the position switches, either 'binary' or 'gray'."
+    )
+    invert_code: bool = Field(
+        False,
+        description="Inverts the position pins. When set to True, the pins are active LOW."
+    )
+    first_code: int = Field(
+        0,
+        ge=0,
+        description="The code reported by the switches when the first tool is in position. "
+        "Set to 1 when the turret reports the tool number (starting at 1)."
+    )
+    code_stable: float = Field(
+        100,
+        ge=0,
+        description="The time (in microseconds) the code must be stable before it is used. "
+        "A stable code which does not correspond to a pocket puts the toolerator in the ERROR "
+        "state."
+    )
+
+
+class TooleratorEncoderConfig(ModuleInstanceBaseModel):
+    pin_A: str = Field(
+        ...,
+        description="The pin on the FPGA-card for the A-signal of the encoder. This pin MUST "
+        "be configured as input."
+    )
+    pin_B: str = Field(
+        ...,
+        description="The pin on the FPGA-card for the B-signal of the encoder. This pin MUST "
+        "be configured as input."
+    )
+    cpr: int = Field(
+        ...,
+        gt=0,
+        description="The number of counts per full revolution of the turret. Each edge of the "
+        "A- and B-signal is counted, so this is four times the number of lines of the encoder "
+        "multiplied by the gear ratio."
+    )
+    reverse: bool = Field(
+        False,
+        description="Reverses the direction of the encoder."
+    )
+    max_following_error: float = Field(
+        ...,
+        gt=0,
+        description="The maximum difference (in degrees) between the position of the stepgen "
+        "and the position measured by the encoder. When exceeded, the turret is stopped, loses "
+        "its reference and enters the ERROR state."
+    )
+
+
+class TooleratorLockConfig(ModuleInstanceBaseModel):
+    lock_pin: str = Field(
+        ...,
+        description="The pin on the FPGA-card for the lock confirmation (clamp) sensor. This pin "
+        "MUST be configured as input. The tool change has finished as soon as the lock has been "
+        "confirmed, without completing the move back over the full over-travel."
+    )
+    invert_lock: bool = Field(
+        False,
+        description="Inverts the lock pin. When set to True, the lock pin is active LOW."
+    )
+    lock_timeout: float = Field(
+        1.0,
+        gt=0,
+        description="The time (in seconds) after the start of the move back in which the lock "
+        "must be confirmed. Otherwise, the toolerator enters the ERROR state."
+    )
+
+
+class TooleratorSequenceConfig(ModuleInstanceBaseModel):
+    input_pins: conlist(item_type=str, max_items=8) = Field(
+        [],
+        description="The pins on the FPGA-card for the sensors used in the program, for example "
+        "the clamp and unclamp sensors. These pins MUST be configured as input."
+    )
+    invert_inputs: bool = Field(
+        False,
+        description="Inverts the input pins. When set to True, the inputs are active LOW."
+    )
+    output_pins: conlist(item_type=str, max_items=8) = Field(
+        [],
+        description="The pins on the FPGA-card for the outputs used in the program, for example "
+        "the clamp and unclamp valves. The outputs keep their state when the toolerator is "
+        "disabled or enters the ERROR state."
+    )
+    wait_timeout: float = Field(
+        5.0,
+        gt=0,
+        description="The maximum time (in seconds) a `wait_high` or `wait_low` instruction waits "
+        "for its input. Otherwise, the toolerator enters the ERROR state."
+    )
+    program: conlist(item_type=str, min_items=1, max_items=255) = Field(
+        ...,
+        description="The program executed for each tool change, replacing the default move. "
+        "Each instruction is a string with an operation and an argument: `set <output>`, "
+        "`clear <output>`, `wait_high <input>`, `wait_low <input>`, `delay <seconds>`, "
+        "`move` (index move including the over-travel and the move back into the ratchet) and "
+        "`rotate` (index move without over-travel, for example for a Hirth coupling). Inputs "
+        "and outputs are referred to by their index in `input_pins` and `output_pins`. The tool "
+        "change has finished at the end of the program."
+    )
+
+
+class TooleratorCarouselConfig(ModuleInstanceBaseModel):
+    table_size: int = Field(
+        256,
+        ge=1,
+        le=4096,
+        description="The number of tool IDs in the tool table. Tool IDs from `table_size` "
+        "onwards are not in the carousel. Cannot exceed the range of the tool numbers (see "
+        "`tool_width`)."
+    )
+    bidirectional: bool = Field(
+        True,
+        description="When set to True, the carousel moves in the shortest direction to the pocket. "
+        "The over-travel is applied in the direction of the move. Only use this for tool changers "
+        "without a ratchet."
+    )
+
+
+class TooleratorEventConfig(ModuleInstanceBaseModel):
+    depth: Literal[8, 16, 32, 64, 128, 256] = Field(
+        16,
+        description="The number of state transitions which are kept in the FPGA until these "
+        "are read by the driver. The driver reads up to 4 transitions each cycle."
+    )
+
+
+class TooleratorScopeConfig(ModuleInstanceBaseModel):
+    depth: Literal[256, 512, 1024, 2048, 4096] = Field(
+        1024,
+        description="The number of samples stored in a single capture."
+    )
+    decimation: int = Field(
+        64,
+        ge=1,
+        le=65535,
+        description="The number of clock cycles between two samples."
+    )
+
+
+class TooleratorTuningConfig(ModuleInstanceBaseModel):
+    max_vel: float = Field(
+        ...,
+        gt=0,
+        description="The highest speed (in steps per second) tried during tuning."
+    )
+    max_acc: float = Field(
+        ...,
+        gt=0,
+        description="The highest acceleration (in steps per second squared) tried during tuning."
+    )
+    start: float = Field(
+        0.5,
+        gt=0,
+        le=1,
+        description="The fraction of the highest speed and acceleration used for the first "
+        "trial revolution."
+    )
+    levels: int = Field(
+        8,
+        ge=1,
+        le=32,
+        description="The number of trial revolutions. The speed and acceleration are increased "
+        "in equal steps from `start` to the highest values."
+    )
+    max_drift: float = Field(
+        1.0,
+        gt=0,
+        description="The maximum difference (in degrees) between the position of the home switch "
+        "found during a trial revolution and the reference. When exceeded, steps have been missed."
+    )
 
 
 class TooleratorInstanceConfig(ModuleInstanceBaseModel):
@@ -93,7 +317,13 @@ class TooleratorInstanceConfig(ModuleInstanceBaseModel):
         ...,
         description="The maximum number of tools in the toolerator. For the EMCO 5 CNC "
         "this is 6 tools, for the EMCO 120 this number is 8 tools. The maximum number of "
-        "tools is 255."
+        "tools is 255, or 65535 when `tool_width` is 16."
+    )
+    tool_width: Literal[8, 16] = Field(
+        8,
+        description="The width (in bits) of the tool numbers and pockets exchanged with the "
+        "FPGA. The default of 8 bits uses the compact layout, which is sufficient for turrets. "
+        "Select 16 bits for large carousels or tool IDs beyond 255."
     )
     ppr: int = Field(
         ...,
@@ -105,6 +335,21 @@ class TooleratorInstanceConfig(ModuleInstanceBaseModel):
         "ratchet to lock (in degrees). For every change this angle is added to the movement "
         "and afterwards the turret will be rotated this amount back."
     )
+    keep_reference_on_disable: bool = Field(
+        False,
+        description="When set to True, the turret keeps its reference when it is disabled while "
+        "it is locked at a pocket (for example on an e-stop or watchdog bite), so it can resume "
+        "immediately without homing. When the turret is disabled during a move or homing, the "
+        "reference is always lost. Only applies when the turret can be homed."
+    )
+    queue_depth: int = Field(
+        8,
+        ge=1,
+        le=255,
+        description="The number of tools which can be queued in the firmware. Queued tools "
+        "are executed back-to-back, without waiting for the host to acknowledge each tool "
+        "change."
+    )
     stepgen: StepgenConfig = Field(
         ...,
         description=""
@@ -113,6 +358,52 @@ class TooleratorInstanceConfig(ModuleInstanceBaseModel):
         None,
         description=""
     )
+    position_code: TooleratorPositionCodeConfig = Field(
+        None,
+        description="Coded position switches, which report the absolute position of the "
+        "turret (optional)."
+    )
+    encoder: TooleratorEncoderConfig = Field(
+        None,
+        description="Quadrature encoder on the turret, used to detect missed steps (optional)."
+    )
+    lock_confirm: TooleratorLockConfig = Field(
+        None,
+        description="Sensor which confirms the turret has been locked (optional)."
+    )
+    carousel: TooleratorCarouselConfig = Field(
+        None,
+        description="Carousel mode (optional). The tool number is a tool ID, which is "
+        "looked up in a table with the pocket of each tool. The table is kept in the FPGA and is "
+        "updated by the driver. Initially tool ID `n` is in pocket `n`."
+    )
+    sequence: TooleratorSequenceConfig = Field(
+        None,
+        description="Program for turrets which require a sequence of outputs and sensors for "
+        "each tool change, such as lift / rotate / clamp turrets (optional). The program runs "
+        "in the FPGA at clock resolution. The program also runs for homing, in which case the "
+        "first `move` or `rotate` instruction is replaced by the homing sequence. Tuning is not "
+        "supported in combination with a program."
+    )
+    tuning: TooleratorTuningConfig = Field(
+        None,
+        description="Settings for finding the highest speed and acceleration which can be used "
+        "without missing steps (optional). Tuning requires a home switch or an encoder and "
+        "cannot be combined with a sequence program."
+    )
+    events: TooleratorEventConfig = Field(
+        None,
+        description="Log of the state transitions, including the time and position of each "
+        "transition (optional). Short states, which are not seen by the driver when sampling "
+        "the state each cycle, are recorded as well."
+    )
+    scope: TooleratorScopeConfig = Field(
+        None,
+        description="Capture of the trajectory of the stepgen (optional). The capture is armed "
+        "with the pin `scope-arm` and starts at the start of the next move or homing. The "
+        "capture is read with `litexcnc_toolerator.tools.scope` and does not add data to "
+        "the data exchanged each cycle."
+    )
     pins: ClassVar[List[str]] = Field(
         [
             ...
@@ -130,6 +421,12 @@ class TooleratorInstanceConfig(ModuleInstanceBaseModel):
         "the end-user defines a name for this instance." 
     )
 
+    @property
+    def fingerprint(self):
+        # Checksum of the configuration, used by the driver to discard the state of a
+        # previous run when the configuration of the turret has changed
+        return zlib.crc32(self.json(sort_keys=True).encode())
+
 
 class TooleratorModuleConfig(ModuleBaseModel):
     """
@@ -137,23 +434,74 @@ class TooleratorModuleConfig(ModuleBaseModel):
     """
     module_type: Literal['toolerator'] = 'toolerator'
     module_id: ClassVar[int] = 0x4e32796a  # Must be equal to litexcnc_toolerator.h
+    record_size: ClassVar[int] = 36  # Size (in bytes) of the config data of each instance
     driver_files: ClassVar[List[str]] = [
         os.path.dirname(__file__) + '/../driver/litexcnc_toolerator.c',
-        os.path.dirname(__file__) + '/../driver/litexcnc_toolerator.h'
+        os.path.dirname(__file__) + '/../driver/litexcnc_toolerator.h',
+        os.path.dirname(__file__) + '/../driver/litexcnc_toolerator_layout.h',
+        os.path.dirname(__file__) + '/../driver/litexcnc_toolerator_board.h'
     ]
+    board_header: ClassVar[str] = os.path.dirname(__file__) + '/../driver/litexcnc_toolerator_board.h'
     instances: conlist(
             item_type=TooleratorInstanceConfig,
             unique_items=True,
             min_items=1,
-            max_items=3
+            max_items=65535
         ) = Field(
             ...,
         )
+    specialise_driver: bool = Field(
+        False,
+        description="When set to True, the driver is specialised for this board: the number of "
+        "instances and the tool count, tool width and mode of each instance are compiled into "
+        "the driver. The driver is specialised with `python -m litexcnc_toolerator.config.toolerator "
+        "<config> --write` and has to be re-installed afterwards; it then refuses boards with "
+        "another configuration. Only use this for fixed configurations."
+    )
 
     def create_from_config(self, soc, watchdog):
         # Deferred imports to prevent importing Litex while installing the driver
         from litexcnc_toolerator.firmware import TooleratorModule
+        # The driver shipped with this package must be able to read the firmware
+        if layout_header_outdated():
+            raise ValueError(
+                "The layout header of the driver is outdated, update it with "
+                "`python -m litexcnc_toolerator.config.layout --write`."
+            )
         TooleratorModule.create_from_config(soc, watchdog, self)
+
+    def generate_board_header(self) -> str:
+        """Returns the C header with the settings of this board, which is included by the
+        driver. Without `specialise_driver` the header is empty and the driver reads the
+        settings from the config block at runtime. The header shipped with the driver is
+        empty; it is only replaced on request, see the command at the end of this file.
+        """
+        lines = [
+            "/********************************************************************",
+            "* Description:  litexcnc_toolerator_board.h",
+            "*               Settings of the board the driver is specialised for",
+            "*",
+            "* Generated by litexcnc_toolerator.config.toolerator, do not edit. Run",
+            "* python -m litexcnc_toolerator.config.toolerator to specialise the",
+            "* driver for a board.",
+            "********************************************************************/",
+            "#ifndef __INCLUDE_LITEXCNC_TOOLERATOR_BOARD_H__",
+            "#define __INCLUDE_LITEXCNC_TOOLERATOR_BOARD_H__",
+            "",
+        ]
+        if self.specialise_driver:
+            def per_instance(values):
+                # Conditional expression, which is constant when the index is constant
+                return " : ".join(f"(index) == {index} ? {value}" for index, value in enumerate(values)) + " : 0"
+            lines += [
+                f"#define LITEXCNC_TOOLERATOR_BOARD_INSTANCES {len(self.instances)}",
+                f"#define LITEXCNC_TOOLERATOR_BOARD_TOOL_COUNT(index) ({per_instance(instance.tool_count for instance in self.instances)})",
+                f"#define LITEXCNC_TOOLERATOR_BOARD_TOOL_WIDTH(index) ({per_instance(instance.tool_width for instance in self.instances)})",
+                f"#define LITEXCNC_TOOLERATOR_BOARD_CAROUSEL(index) ({per_instance(int(instance.carousel is not None) for instance in self.instances)})",
+                "",
+            ]
+        lines += ["#endif", ""]
+        return "\n".join(lines)
     
     def add_mmio_config_registers(self, mmio):
         # Deferred imports to prevent importing Litex while installing the driver
@@ -172,28 +520,155 @@ class TooleratorModuleConfig(ModuleBaseModel):
 
     @property
     def config_size(self):
-        return 4
+        # Header with the number of instances, the size of the data of each instance and
+        # the checksum of the layout, followed by 9 words with the motion data, the 
+        # fingerprint, the mode and the tool count of each instance
+        return 8 + self.record_size * len(self.instances)
 
     def store_config(self, mmio):
         # Deferred imports to prevent importing Litex while installing the driver
         from litex.soc.interconnect.csr import CSRStatus, CSRField
-        # Get the tool counts for each instance if defined
-        tc0 = 0
-        if len(self.instances):
-            tc0 = self.instances[0].tool_count
-        tc1 = 0
-        if len(self.instances) > 1:
-            tc1 = self.instances[1].tool_count
-        tc2 = 0
-        if len(self.instances) > 2:
-            tc2 = self.instances[2].tool_count
-        # Create the config
+        # Create the config. The config block is self-describing: the header contains the
+        # number of instances and the size of the data of each instance, so the driver can
+        # size its buffers from the block and skip data it does not know.
         mmio.toolerator_config_data =  CSRStatus(
             fields=[
-                CSRField("max_tools3", size=8, offset=0,  description="The requested tool - instance 2.", reset=tc2),
-                CSRField("max_tools2", size=8, offset=8,  description="The requested tool - instance 1.", reset=tc1),
-                CSRField("max_tools1", size=8, offset=16, description="The requested tool - instance 0.", reset=tc0),
-                CSRField("instances", size=8,  offset=24, description="The requested tool.", reset=len(self.instances)),
+                CSRField("record_size", size=16, offset=0,  description="The size (in bytes) of the data of each instance.", reset=self.record_size),
+                CSRField("instances", size=16,  offset=16, description="The number of instances.", reset=len(self.instances)),
             ],
             description=f"The config of the toolerator module."
         )
+        mmio.toolerator_config_layout = CSRStatus(
+            size=32,
+            name='toolerator_config_layout',
+            description="Checksum of the layout of the registers, see litexcnc_toolerator.config.layout.",
+            reset=layout_hash()
+        )
+        # Create the motion data for each instance, used by the driver to estimate the
+        # duration of a tool change
+        for index, instance in enumerate(self.instances):
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_ppr',
+                CSRStatus(
+                    size=32,
+                    name=f'toolerator_config_{index}_ppr',
+                    description=f"The number of pulses per revolution - instance {index}.",
+                    reset=instance.ppr
+                )
+            )
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_over_travel',
+                CSRStatus(
+                    size=32,
+                    name=f'toolerator_config_{index}_over_travel',
+                    description=f"The over-travel in steps - instance {index}.",
+                    reset=int(instance.ppr * instance.over_travel / 360)
+                )
+            )
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_max_vel',
+                CSRStatus(
+                    size=32,
+                    name=f'toolerator_config_{index}_max_vel',
+                    description=f"The maximum speed in steps per second - instance {index}.",
+                    reset=int(round(instance.stepgen.speed.max_vel))
+                )
+            )
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_max_acc',
+                CSRStatus(
+                    size=32,
+                    name=f'toolerator_config_{index}_max_acc',
+                    description=f"The maximum acceleration in steps per second squared - instance {index}.",
+                    reset=int(round(instance.stepgen.speed.max_acc))
+                )
+            )
+            lock_speed = instance.stepgen.lock_speed or instance.stepgen.speed
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_lock_max_vel',
+                CSRStatus(
+                    size=32,
+                    name=f'toolerator_config_{index}_lock_max_vel',
+                    description=f"The maximum speed of the lock move in steps per second - instance {index}.",
+                    reset=int(round(lock_speed.max_vel))
+                )
+            )
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_lock_max_acc',
+                CSRStatus(
+                    size=32,
+                    name=f'toolerator_config_{index}_lock_max_acc',
+                    description=f"The maximum acceleration of the lock move in steps per second squared - instance {index}.",
+                    reset=int(round(lock_speed.max_acc))
+                )
+            )
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_fingerprint',
+                CSRStatus(
+                    size=32,
+                    name=f'toolerator_config_{index}_fingerprint',
+                    description=f"Checksum of the configuration - instance {index}.",
+                    reset=instance.fingerprint
+                )
+            )
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_mode',
+                CSRStatus(
+                    fields=[
+                        CSRField("carousel", size=1, offset=0, description="The tool number is a tool ID.", reset=int(instance.carousel is not None)),
+                        CSRField("bidirectional", size=1, offset=1, description="The carousel moves in the shortest direction.", reset=int(instance.carousel is not None and instance.carousel.bidirectional)),
+                        CSRField("scope", size=1, offset=2, description="The trajectory of the stepgen can be captured.", reset=int(instance.scope is not None)),
+                        CSRField("sequence", size=1, offset=3, description="Tool changes run the sequence program.", reset=int(instance.sequence is not None)),
+                        CSRField("tool_width", size=8, offset=8, description="The width (in bits) of the tool numbers.", reset=instance.tool_width),
+                        CSRField("event_depth", size=16, offset=16, description="The depth of the log of state transitions (0 when disabled).", reset=instance.events.depth if instance.events else 0),
+                    ],
+                    name=f'toolerator_config_{index}_mode',
+                    description=f"The mode of the toolchanger - instance {index}."
+                )
+            )
+            setattr(
+                mmio,
+                f'toolerator_config_{index}_tools',
+                CSRStatus(
+                    fields=[
+                        CSRField("tool_count", size=16, offset=0, description="The number of tools.", reset=instance.tool_count),
+                        CSRField("table_size", size=16, offset=16, description="The number of tool IDs in the tool table (carousel mode only).", reset=instance.carousel.table_size if instance.carousel else 0),
+                    ],
+                    name=f'toolerator_config_{index}_tools',
+                    description=f"The tool count of the toolchanger - instance {index}."
+                )
+            )
+
+
+if __name__ == "__main__":
+    # Specialises the driver for the board defined in the configuration of the firmware, or
+    # restores the generic driver when no configuration is given. Without `--write` the
+    # header is printed.
+    import argparse
+    import json
+    import sys
+    parser = argparse.ArgumentParser(description="Generates the board header of the driver.")
+    parser.add_argument('config', nargs='?', help="The configuration (JSON) of the firmware, omit for the generic driver.")
+    parser.add_argument('--write', action='store_true', help="Update the header shipped with the driver, re-install the driver afterwards.")
+    args = parser.parse_args()
+    # The generic header does not depend on the instances
+    board = TooleratorModuleConfig.construct(instances=[], specialise_driver=False)
+    if args.config:
+        with open(args.config) as file:
+            modules = [module for module in json.load(file).get('modules', []) if module.get('module_type') == 'toolerator']
+        if len(modules) != 1:
+            sys.exit(f"{args.config} must contain a single toolerator module.")
+        board = TooleratorModuleConfig(**modules[0])
+    if args.write:
+        with open(TooleratorModuleConfig.board_header, 'w') as header:
+            header.write(board.generate_board_header())
+    else:
+        print(board.generate_board_header(), end="")
@@ -34,6 +34,7 @@
 */
 #include <inttypes.h>
 #include <math.h>
+#include <stdio.h>
 
 #include "hal.h"
 #include "rtapi.h"
@@ -43,12 +44,51 @@
 #include "litexcnc_toolerator.h"
 
 /** 
- * An array holding all instance for the module. As each boarf normally have a 
+ * Registry holding all instances for the module. As each board normally have a 
  * single instance of a type, this number coincides with the number of boards
- * which are supported by LitexCNC
+ * which are supported by LitexCNC. The registry is allocated in HAL shared memory
+ * when the module is loaded.
  */
-static litexcnc_toolerator_t *instances[MAX_INSTANCES];
-static int num_instances = 0;
+static litexcnc_toolerator_registry_t *registry = NULL;
+
+/**
+ * Flags of each state of the toolerator, used to decode the status received from the
+ * FPGA. The states are generated from the firmware, see litexcnc_toolerator_layout.h.
+ */
+static const uint8_t litexcnc_toolerator_state_flags[LITEXCNC_TOOLERATOR_STATE_COUNT] = {
+    [LITEXCNC_TOOLERATOR_STATE_HOME_SEARCHING]    = LITEXCNC_TOOLERATOR_FLAG_HOMING | LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_HOME_BACK_OFF]     = LITEXCNC_TOOLERATOR_FLAG_HOMING | LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_HOME_LATCHING]     = LITEXCNC_TOOLERATOR_FLAG_HOMING | LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_HOME_MOVE_TO_ZERO] = LITEXCNC_TOOLERATOR_FLAG_HOMING | LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_MOVING_FORWARD]    = LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_MOVING_BACKWARD]   = LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_READY]             = LITEXCNC_TOOLERATOR_FLAG_READY,
+    [LITEXCNC_TOOLERATOR_STATE_ERROR]             = LITEXCNC_TOOLERATOR_FLAG_ERROR | LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_TUNING]            = LITEXCNC_TOOLERATOR_FLAG_TUNING | LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_SEQUENCING]        = LITEXCNC_TOOLERATOR_FLAG_BUSY,
+    [LITEXCNC_TOOLERATOR_STATE_MOVING_REVERSE]    = LITEXCNC_TOOLERATOR_FLAG_BUSY,
+};
+
+/**
+ * Parameter with the file in which the state of the turrets is stored between runs.
+ * When not set, the state is not stored.
+ */
+static char *state_file = NULL;
+RTAPI_MP_STRING(state_file, "File to store the position of the turrets between runs");
+
+/**
+ * Parameter to enable the trace of the status and commands of the toolerators in 
+ * shared memory, see litexcnc_toolerator_trace_t. 
+ */
+static int trace = 0;
+RTAPI_MP_INT(trace, "Set to 1 to write a trace of the toolerators to shared memory");
+
+/**
+ * Parameter to enable the recording of the cycles in shared memory, see 
+ * litexcnc_toolerator_record_t.
+ */
+static int record = 0;
+RTAPI_MP_INT(record, "Set to 1 to record the inputs and the data exchanged with the FPGA for replay");
 
 /**
  * Parameter which contains the registration of this module woth LitexCNC 
@@ -86,6 +126,22 @@ int rtapi_app_main(void) {
     comp_id = hal_init(LITEXCNC_TOOLERATOR_NAME);
     if(comp_id < 0) return comp_id;
 
+    // Create the registry of boards
+    registry = (litexcnc_toolerator_registry_t *)hal_malloc(sizeof(litexcnc_toolerator_registry_t));
+    if (registry == NULL) {
+        LITEXCNC_ERR_NO_DEVICE("Out of memory!\n");
+        hal_exit(comp_id);
+        return -ENOMEM;
+    }
+    registry->count = 0;
+    registry->capacity = LITEXCNC_TOOLERATOR_INITIAL_BOARDS;
+    registry->boards = (litexcnc_toolerator_t **)hal_malloc(registry->capacity * sizeof(litexcnc_toolerator_t *));
+    if (registry->boards == NULL) {
+        LITEXCNC_ERR_NO_DEVICE("Out of memory!\n");
+        hal_exit(comp_id);
+        return -ENOMEM;
+    }
+
     // Register the module with LitexCNC (NOTE: LitexCNC should be loaded first)
     int result = register_toolerator_module();
     if (result<0) return result;
@@ -98,6 +154,15 @@ int rtapi_app_main(void) {
 
 
 void rtapi_app_exit(void) {
+    litexcnc_toolerator_save_state();
+    for (size_t i=0; (registry != NULL) && (i<registry->count); i++) {
+        if (registry->boards[i]->data.trace != NULL) {
+            rtapi_shmem_delete(registry->boards[i]->data.trace_shmem_id, comp_id);
+        }
+        if (registry->boards[i]->data.record != NULL) {
+            rtapi_shmem_delete(registry->boards[i]->data.record_shmem_id, comp_id);
+        }
+    }
     hal_exit(comp_id);
     LITEXCNC_PRINT_NO_DEVICE("LitexCNC toolerator module driver unloaded \n");
 }
@@ -110,21 +175,45 @@ size_t required_config_buffer(void *module) {
     if (toolerator_module->num_instances == 0) {
         return 0;
     }
-    return sizeof(litexcnc_toolerator_config_data_t);
+    return toolerator_module->num_instances * sizeof(litexcnc_toolerator_instance_config_data_t);
 }
 
 
 size_t required_write_buffer(void *module) {
     static litexcnc_toolerator_t *toolerator_module;
     toolerator_module = (litexcnc_toolerator_t *) module;
-    return toolerator_module->num_instances * sizeof(litexcnc_toolerator_instance_write_data_t);
+    // Instances with 16-bit tool numbers exchange the upper bytes in an additional register
+    // and instances with a log of state transitions exchange the transitions
+    size_t size = 0;
+    for (size_t i=0; i<LITEXCNC_TOOLERATOR_NUM_INSTANCES(toolerator_module); i++) {
+        size += sizeof(litexcnc_toolerator_instance_write_data_t);
+        if (LITEXCNC_TOOLERATOR_TOOL_WIDTH(&(toolerator_module->instances[i]), i) > 8) {
+            size += sizeof(litexcnc_toolerator_instance_write_data_high_t);
+        }
+        if (toolerator_module->instances[i].data.event_depth) {
+            size += sizeof(litexcnc_toolerator_instance_write_data_events_t);
+        }
+    }
+    return size;
 }
 
 
 size_t required_read_buffer(void *module) {
     static litexcnc_toolerator_t *toolerator_module;
     toolerator_module = (litexcnc_toolerator_t *) module;
-    return toolerator_module->num_instances * sizeof(litexcnc_toolerator_instance_read_data_t);
+    // Instances with 16-bit tool numbers exchange the upper bytes in an additional register
+    // and instances with a log of state transitions exchange the transitions
+    size_t size = 0;
+    for (size_t i=0; i<LITEXCNC_TOOLERATOR_NUM_INSTANCES(toolerator_module); i++) {
+        size += sizeof(litexcnc_toolerator_instance_read_data_t);
+        if (LITEXCNC_TOOLERATOR_TOOL_WIDTH(&(toolerator_module->instances[i]), i) > 8) {
+            size += sizeof(litexcnc_toolerator_instance_read_data_high_t);
+        }
+        if (toolerator_module->instances[i].data.event_depth) {
+            size += sizeof(litexcnc_toolerator_instance_read_data_events_t);
+        }
+    }
+    return size;
 }
 
 
@@ -137,6 +226,39 @@ size_t litexcnc_toolerator_init(litexcnc_module_instance_t **module, litexcnc_t
     // Store where the config data starts
     uint8_t *config_start = *config;
 
+    // Read the header of the config block. The layout of the registers in the firmware
+    // must be equal to the layout the driver has been compiled with.
+    litexcnc_toolerator_init_header_t header;
+    memcpy(&header, *config, sizeof(litexcnc_toolerator_init_header_t));
+    if (be32toh(header.layout_hash) != LITEXCNC_TOOLERATOR_LAYOUT_HASH) {
+        LITEXCNC_ERR_NO_DEVICE(
+            "Layout of the toolerator registers in the firmware (%08" PRIx32 ") differs from the driver (%08" PRIx32 "), re-install the driver\n",
+            (uint32_t) be32toh(header.layout_hash),
+            (uint32_t) LITEXCNC_TOOLERATOR_LAYOUT_HASH
+        );
+        return -EINVAL;
+    }
+#ifdef LITEXCNC_TOOLERATOR_BOARD_INSTANCES
+    // The driver has been specialised for a board, other configurations are refused
+    if (be16toh(header.instances) != LITEXCNC_TOOLERATOR_BOARD_INSTANCES) {
+        LITEXCNC_ERR_NO_DEVICE(
+            "Driver is specialised for %d toolerator instances, board has %d instances, re-install the driver\n",
+            LITEXCNC_TOOLERATOR_BOARD_INSTANCES,
+            be16toh(header.instances)
+        );
+        return -EINVAL;
+    }
+#endif
+    // The settings of each instance cannot be defaulted, older firmware is refused
+    if (be16toh(header.record_size) < sizeof(litexcnc_toolerator_instance_init_data_t)) {
+        LITEXCNC_ERR_NO_DEVICE(
+            "Size of the config data of each toolerator instance (%d) is smaller than required (%zu), rebuild the firmware\n",
+            be16toh(header.record_size),
+            sizeof(litexcnc_toolerator_instance_init_data_t)
+        );
+        return -EINVAL;
+    }
+
     // Create structure in memory
     (*module) = (litexcnc_module_instance_t *)hal_malloc(sizeof(litexcnc_module_instance_t));
     (*module)->prepare_write    = &litexcnc_toolerator_prepare_write;
@@ -146,25 +268,67 @@ size_t litexcnc_toolerator_init(litexcnc_module_instance_t **module, litexcnc_t
         
     // Cast from void to correct type and store it
     litexcnc_toolerator_t *toolerator = (litexcnc_toolerator_t *) (*module)->instance_data;
-    instances[num_instances] = toolerator;
-    num_instances++;
+    toolerator->data.fpga_name = litexcnc->fpga->name;
+    toolerator->data.record = NULL;
+    toolerator->data.trace = NULL;
 
     // Store the amount of toolerator instances on this board and allocate HAL shared memory
-    toolerator->num_instances = *(*config);
+    toolerator->num_instances = be16toh(header.instances);
+    size_t record_size = be16toh(header.record_size);
     toolerator->instances = (litexcnc_toolerator_instance_t *)hal_malloc(toolerator->num_instances * sizeof(litexcnc_toolerator_instance_t));
     if (toolerator->instances == NULL) {
         LITEXCNC_ERR_NO_DEVICE("Out of memory!\n");
         return -ENOMEM;
     }
-    (*config) += 1;
+    *config = config_start + sizeof(litexcnc_toolerator_init_header_t);
 
     // Create the pins and params in the HAL
     for (size_t i=0; i<toolerator->num_instances; i++) {
         litexcnc_toolerator_instance_t *instance = &(toolerator->instances[i]);
         
-        // Store the amount of tools in the toolchanger
-        instance->hal.param.tool_count = *(*config);
-        (*config) += 1;
+        // Store the motion settings, used to estimate the duration of a tool change
+        litexcnc_toolerator_instance_init_data_t init_data;
+        memcpy(
+            &init_data, 
+            config_start + sizeof(litexcnc_toolerator_init_header_t) + i * record_size, 
+            sizeof(litexcnc_toolerator_instance_init_data_t)
+        );
+        instance->data.ppr = be32toh(init_data.ppr);
+        instance->data.over_travel = be32toh(init_data.over_travel);
+        instance->data.max_vel = be32toh(init_data.max_vel);
+        instance->data.max_acc = be32toh(init_data.max_acc);
+        instance->data.lock_max_vel = be32toh(init_data.lock_max_vel);
+        instance->data.lock_max_acc = be32toh(init_data.lock_max_acc);
+        instance->data.fingerprint = be32toh(init_data.fingerprint);
+        instance->data.carousel = be32toh(init_data.mode) & 0x01;
+        instance->data.bidirectional = be32toh(init_data.mode) & 0x02;
+        instance->data.scope = be32toh(init_data.mode) & 0x04;
+        instance->data.sequence = be32toh(init_data.mode) & 0x08;
+        instance->data.tool_width = (be32toh(init_data.mode) >> 8) & 0xFF;
+        instance->hal.param.tool_count = be32toh(init_data.tools) & 0xFFFF;
+        instance->data.table_size = be32toh(init_data.tools) >> 16;
+        instance->data.event_depth = be32toh(init_data.mode) >> 16;
+        instance->data.event_synced = false;
+#ifdef LITEXCNC_TOOLERATOR_BOARD_INSTANCES
+        if ((instance->hal.param.tool_count != LITEXCNC_TOOLERATOR_BOARD_TOOL_COUNT(i)) ||
+            (instance->data.tool_width != LITEXCNC_TOOLERATOR_BOARD_TOOL_WIDTH(i)) ||
+            (instance->data.carousel != LITEXCNC_TOOLERATOR_BOARD_CAROUSEL(i))) {
+            LITEXCNC_ERR_NO_DEVICE("Driver is specialised for another configuration of toolerator %zu, re-install the driver\n", i);
+            return -EINVAL;
+        }
+#endif
+        // Copy of the tool table in the FPGA, used to estimate the duration of a tool change
+        if (instance->data.carousel) {
+            instance->data.table = (uint16_t *)hal_malloc(instance->data.table_size * sizeof(uint16_t));
+            if (instance->data.table == NULL) {
+                LITEXCNC_ERR_NO_DEVICE("Out of memory!\n");
+                return -ENOMEM;
+            }
+            for (size_t tool=0; tool<instance->data.table_size; tool++) {
+                instance->data.table[tool] = (tool < instance->hal.param.tool_count) ? tool : (1 << instance->data.tool_width) - 1;
+            }
+            instance->data.lookup_pocket = UINT32_MAX;
+        }
         
         // Create the basename
         LITEXCNC_CREATE_BASENAME("toolerator", i);
@@ -173,6 +337,8 @@ size_t litexcnc_toolerator_init(litexcnc_module_instance_t **module, litexcnc_t
         // Param types: float, bit, u32, s32
         // Param directions: HAL_RO, HAL_RW
         LITEXCNC_CREATE_HAL_PARAM("tool_count", u32, HAL_RO, &(instance->hal.param.tool_count));
+        LITEXCNC_CREATE_HAL_PARAM("tune_margin", float, HAL_RW, &(instance->hal.param.tune_margin));
+        instance->hal.param.tune_margin = 0.2;
 
         // Create the pins
         // Pin types: float, bit, u32, s32
@@ -181,15 +347,82 @@ size_t litexcnc_toolerator_init(litexcnc_module_instance_t **module, litexcnc_t
         LITEXCNC_CREATE_HAL_PIN("error", bit, HAL_OUT, &(instance->hal.pin.error));
         LITEXCNC_CREATE_HAL_PIN("homing", bit, HAL_OUT, &(instance->hal.pin.homing));
         LITEXCNC_CREATE_HAL_PIN("homed", bit, HAL_OUT, &(instance->hal.pin.homed));
+        LITEXCNC_CREATE_HAL_PIN("home", bit, HAL_IN, &(instance->hal.pin.home));
         LITEXCNC_CREATE_HAL_PIN("enable", bit, HAL_IN, &(instance->hal.pin.enable));
         LITEXCNC_CREATE_HAL_PIN("tool-change", bit, HAL_IN, &(instance->hal.pin.tool_change));
         LITEXCNC_CREATE_HAL_PIN("tool-changed", bit, HAL_OUT, &(instance->hal.pin.tool_changed));
         LITEXCNC_CREATE_HAL_PIN("tool-number", u32, HAL_IN, &(instance->hal.pin.tool_number));
         LITEXCNC_CREATE_HAL_PIN("current-tool", u32, HAL_OUT, &(instance->hal.pin.current_tool));
+        LITEXCNC_CREATE_HAL_PIN("current-pocket", u32, HAL_OUT, &(instance->hal.pin.current_pocket));
+        LITEXCNC_CREATE_HAL_PIN("queue-tool-number", u32, HAL_IN, &(instance->hal.pin.queue_tool_number));
+        LITEXCNC_CREATE_HAL_PIN("queue-push", bit, HAL_IN, &(instance->hal.pin.queue_push));
+        LITEXCNC_CREATE_HAL_PIN("queue-clear", bit, HAL_IN, &(instance->hal.pin.queue_clear));
+        LITEXCNC_CREATE_HAL_PIN("queue-level", u32, HAL_OUT, &(instance->hal.pin.queue_level));
+        LITEXCNC_CREATE_HAL_PIN("queue-full", bit, HAL_OUT, &(instance->hal.pin.queue_full));
+        LITEXCNC_CREATE_HAL_PIN("time-remaining", float, HAL_OUT, &(instance->hal.pin.time_remaining));
+        LITEXCNC_CREATE_HAL_PIN("position-cmd", float, HAL_OUT, &(instance->hal.pin.position_cmd));
+        LITEXCNC_CREATE_HAL_PIN("position-fb", float, HAL_OUT, &(instance->hal.pin.position_fb));
+        LITEXCNC_CREATE_HAL_PIN("following-error", float, HAL_OUT, &(instance->hal.pin.following_error));
+        LITEXCNC_CREATE_HAL_PIN("drift", float, HAL_OUT, &(instance->hal.pin.drift));
+        LITEXCNC_CREATE_HAL_PIN("tune", bit, HAL_IN, &(instance->hal.pin.tune));
+        LITEXCNC_CREATE_HAL_PIN("tuning", bit, HAL_OUT, &(instance->hal.pin.tuning));
+        LITEXCNC_CREATE_HAL_PIN("tune-passed", u32, HAL_OUT, &(instance->hal.pin.tune_passed));
+        LITEXCNC_CREATE_HAL_PIN("tune-max-vel", float, HAL_OUT, &(instance->hal.pin.tune_max_vel));
+        LITEXCNC_CREATE_HAL_PIN("tune-max-acc", float, HAL_OUT, &(instance->hal.pin.tune_max_acc));
+        if (instance->data.scope) {
+            LITEXCNC_CREATE_HAL_PIN("scope-arm", bit, HAL_IN, &(instance->hal.pin.scope_arm));
+        }
+        LITEXCNC_CREATE_HAL_PIN("table-tool", u32, HAL_IN, &(instance->hal.pin.table_tool));
+        LITEXCNC_CREATE_HAL_PIN("table-pocket", u32, HAL_IN, &(instance->hal.pin.table_pocket));
+        LITEXCNC_CREATE_HAL_PIN("table-write", bit, HAL_IN, &(instance->hal.pin.table_write));
+        if (instance->data.event_depth) {
+            LITEXCNC_CREATE_HAL_PIN("event-count", u32, HAL_OUT, &(instance->hal.pin.event_count));
+            LITEXCNC_CREATE_HAL_PIN("event-lost", u32, HAL_OUT, &(instance->hal.pin.event_lost));
+            for (size_t j=0; j<LITEXCNC_TOOLERATOR_EVENT_RING; j++) {
+                char pin_name[HAL_NAME_LEN + 1];
+                rtapi_snprintf(pin_name, sizeof(pin_name), "event.%02zu.state", j);
+                LITEXCNC_CREATE_HAL_PIN(pin_name, u32, HAL_OUT, &(instance->hal.pin.event_state[j]));
+                rtapi_snprintf(pin_name, sizeof(pin_name), "event.%02zu.time", j);
+                LITEXCNC_CREATE_HAL_PIN(pin_name, float, HAL_OUT, &(instance->hal.pin.event_time[j]));
+                rtapi_snprintf(pin_name, sizeof(pin_name), "event.%02zu.position", j);
+                LITEXCNC_CREATE_HAL_PIN(pin_name, float, HAL_OUT, &(instance->hal.pin.event_position[j]));
+            }
+        }
+    }
+
+    // Register the board, only when it has been initialised completely, as the registry
+    // is walked when the state is saved and at exit. The index of the board is used as
+    // key of the trace and the recording.
+    r = litexcnc_toolerator_register_board(toolerator);
+    if (r < 0) {
+        return r;
     }
 
+    // Start the trace of the status and the commands
+    if (trace) {
+        r = litexcnc_toolerator_trace_init(toolerator);
+        if (r < 0) {
+            return r;
+        }
+    }
+
+    // Start the recording, the config block is stored for the replay
+    if (record) {
+        r = litexcnc_toolerator_record_init(
+            toolerator, 
+            config_start, 
+            sizeof(litexcnc_toolerator_init_header_t) + toolerator->num_instances * record_size
+        );
+        if (r < 0) {
+            return r;
+        }
+    }
+
+    // Restore the position of the turrets from the previous run
+    litexcnc_toolerator_restore_state(toolerator);
+
     // Move correct amount of bytes for the next module
-    *config = config_start + 4;
+    *config = config_start + sizeof(litexcnc_toolerator_init_header_t) + toolerator->num_instances * record_size;
 
     return 0;
 }
@@ -198,8 +431,30 @@ size_t litexcnc_toolerator_init(litexcnc_module_instance_t **module, litexcnc_t
 
 int litexcnc_toolerator_config(void *module, uint8_t **data, int period) {
 
-    // NOT USED
-    
+    // Store where the data starts
+    static uint8_t *data_start;
+    data_start = *data;
+
+    // Convert the module to an instance of toolerator
+    static litexcnc_toolerator_t *toolerator;
+    toolerator = (litexcnc_toolerator_t *) module;
+
+    // Write the restored pockets to the FPGA
+    for (size_t i=0; i<toolerator->num_instances; i++) {
+        litexcnc_toolerator_instance_t *instance = &(toolerator->instances[i]);
+        litexcnc_toolerator_instance_config_data_t instance_data;
+        instance_data.restore = htobe32(
+            LITEXCNC_TOOLERATOR_PACK(RESTORE_TOOL_NUMBER, instance->data.restore_tool)
+            | LITEXCNC_TOOLERATOR_PACK(RESTORE_VALID, instance->data.restore_valid)
+        );
+        memcpy(*data, &instance_data, sizeof(litexcnc_toolerator_instance_config_data_t));
+        *data += sizeof(litexcnc_toolerator_instance_config_data_t);
+    }
+
+    // Move the pointer to the end of the configuration data. This aims at preventing
+    // any mis-alignment of data.
+    *data = data_start + required_config_buffer(module);
+
     // Return success
     return 0;
 }
@@ -220,26 +475,101 @@ int litexcnc_toolerator_prepare_write(void *module, uint8_t **data, int period)
     // - module level
     
     // - instance level
-    for (size_t i=0; i<toolerator->num_instances; i++) {
+    LITEXCNC_TOOLERATOR_UNROLL
+    for (size_t i=0; i<LITEXCNC_TOOLERATOR_NUM_INSTANCES(toolerator); i++) {
         // Get toolerator to the stepgen instance
         static litexcnc_toolerator_instance_t *instance;
         instance = &(toolerator->instances[i]);
 
+        // In carousel mode the tool number is a tool ID, which is translated to a pocket by
+        // the FPGA
+        uint32_t tool_mask = (1 << LITEXCNC_TOOLERATOR_TOOL_WIDTH(instance, i)) - 1;
+        uint32_t tool_number, queue_tool_number;
+        if (LITEXCNC_TOOLERATOR_CAROUSEL(instance, i)) {
+            tool_number = *(instance->hal.pin.tool_number) & tool_mask;
+            queue_tool_number = *(instance->hal.pin.queue_tool_number) & tool_mask;
+        } else {
+            tool_number = *(instance->hal.pin.tool_number) % LITEXCNC_TOOLERATOR_TOOL_COUNT(instance, i);
+            queue_tool_number = *(instance->hal.pin.queue_tool_number) % LITEXCNC_TOOLERATOR_TOOL_COUNT(instance, i);
+        }
+        // - command queue; the firmware adds a tool to the queue for each toggle of the
+        //   push bit, so a rising edge on the pin results in exactly one entry
+        if (*(instance->hal.pin.queue_push) && !instance->memo.queue_push) {
+            instance->data.queue_toggle ^= 1;
+        }
+        instance->memo.queue_push = *(instance->hal.pin.queue_push);
+        // - tool table; an entry is written for each toggle of the write bit
+        uint32_t table_pocket = *(instance->hal.pin.table_pocket) & tool_mask;
+        uint32_t table_tool = *(instance->hal.pin.table_tool) & tool_mask;
+        if (*(instance->hal.pin.table_write) && !instance->memo.table_write) {
+            instance->data.table_toggle ^= 1;
+            if (LITEXCNC_TOOLERATOR_CAROUSEL(instance, i) && (table_tool < instance->data.table_size)) {
+                instance->data.table[table_tool] = table_pocket;
+                instance->data.lookup_pocket = UINT32_MAX;
+            }
+        }
+        instance->memo.table_write = *(instance->hal.pin.table_write);
+
         // Create an instance of the data to be copied to the FPGA
         litexcnc_toolerator_instance_write_data_t instance_data;
-        instance_data.enable = *(instance->hal.pin.enable) ? 1 : 0;
-        instance_data.tool_change = *(instance->hal.pin.tool_change) ? 1 : 0;
-        instance_data.tool_number = *(instance->hal.pin.tool_number) % instance->hal.param.tool_count;
+        instance_data.data = htobe32(
+            LITEXCNC_TOOLERATOR_PACK(DATA_TOOL_NUMBER, tool_number)
+            | LITEXCNC_TOOLERATOR_PACK(DATA_TOOL_CHANGE, *(instance->hal.pin.tool_change))
+            | LITEXCNC_TOOLERATOR_PACK(DATA_ENABLED, *(instance->hal.pin.enable))
+            | LITEXCNC_TOOLERATOR_PACK(DATA_HOME, *(instance->hal.pin.home))
+        );
+        instance_data.queue_data = htobe32(
+            LITEXCNC_TOOLERATOR_PACK(QUEUE_DATA_TOOL_NUMBER, queue_tool_number)
+            | LITEXCNC_TOOLERATOR_PACK(QUEUE_DATA_PUSH, instance->data.queue_toggle)
+            | LITEXCNC_TOOLERATOR_PACK(QUEUE_DATA_CLEAR, *(instance->hal.pin.queue_clear))
+        );
+        instance_data.tune_data = htobe32(
+            LITEXCNC_TOOLERATOR_PACK(TUNE_DATA_TUNE, *(instance->hal.pin.tune))
+            | LITEXCNC_TOOLERATOR_PACK(TUNE_DATA_SCOPE_ARM, instance->data.scope && *(instance->hal.pin.scope_arm))
+        );
+        instance_data.table_data = htobe32(
+            LITEXCNC_TOOLERATOR_PACK(TABLE_DATA_TOOL, table_tool)
+            | LITEXCNC_TOOLERATOR_PACK(TABLE_DATA_POCKET, table_pocket)
+            | LITEXCNC_TOOLERATOR_PACK(TABLE_DATA_WRITE, instance->data.table_toggle)
+        );
 
         // Write the data to the FPGA
         memcpy(*data, &instance_data, sizeof(litexcnc_toolerator_instance_write_data_t));
         *data += sizeof(litexcnc_toolerator_instance_write_data_t);
+
+        // - upper bytes of 16-bit tool numbers
+        if (LITEXCNC_TOOLERATOR_TOOL_WIDTH(instance, i) > 8) {
+            litexcnc_toolerator_instance_write_data_high_t instance_data_high;
+            instance_data_high.data_high = htobe32(
+                LITEXCNC_TOOLERATOR_PACK(DATA_HIGH_TOOL_NUMBER, tool_number >> 8)
+                | LITEXCNC_TOOLERATOR_PACK(DATA_HIGH_QUEUE_TOOL_NUMBER, queue_tool_number >> 8)
+                | LITEXCNC_TOOLERATOR_PACK(DATA_HIGH_TABLE_TOOL, table_tool >> 8)
+                | LITEXCNC_TOOLERATOR_PACK(DATA_HIGH_TABLE_POCKET, table_pocket >> 8)
+            );
+            memcpy(*data, &instance_data_high, sizeof(litexcnc_toolerator_instance_write_data_high_t));
+            *data += sizeof(litexcnc_toolerator_instance_write_data_high_t);
+        }
+
+        // - the first state transition to be read in the next cycle
+        if (instance->data.event_depth) {
+            litexcnc_toolerator_instance_write_data_events_t instance_data_events;
+            instance_data_events.event_data = htobe32(
+                LITEXCNC_TOOLERATOR_PACK(EVENT_DATA_READ, instance->data.event_read)
+            );
+            memcpy(*data, &instance_data_events, sizeof(litexcnc_toolerator_instance_write_data_events_t));
+            *data += sizeof(litexcnc_toolerator_instance_write_data_events_t);
+        }
     }
 
     // Move the pointer to the end of the configuration data. This aims at preventing
     // any mis-alignment of data.
     *data = data_start + required_write_buffer(module);
 
+    // Record the data for the replay
+    if (toolerator->data.record != NULL) {
+        litexcnc_toolerator_record(toolerator, LITEXCNC_TOOLERATOR_RECORD_WRITE, data_start, required_write_buffer(module), period);
+    }
+
     // Return success
     return 0;
 }
@@ -255,8 +585,14 @@ int litexcnc_toolerator_process_read(void *module, uint8_t **data, int period) {
     static litexcnc_toolerator_t *toolerator;
     toolerator = (litexcnc_toolerator_t *) module;
 
+    // Record the data for the replay, before it is processed
+    if (toolerator->data.record != NULL) {
+        litexcnc_toolerator_record(toolerator, LITEXCNC_TOOLERATOR_RECORD_READ, data_start, required_read_buffer(module), period);
+    }
+
     // Add any code which processes the read data from the FPGA
-    for (size_t i=0; i<toolerator->num_instances; i++) {
+    LITEXCNC_TOOLERATOR_UNROLL
+    for (size_t i=0; i<LITEXCNC_TOOLERATOR_NUM_INSTANCES(toolerator); i++) {
         // Get toolerator to the stepgen instance
         static litexcnc_toolerator_instance_t *instance;
         instance = &(toolerator->instances[i]);
@@ -265,33 +601,127 @@ int litexcnc_toolerator_process_read(void *module, uint8_t **data, int period) {
         static litexcnc_toolerator_instance_read_data_t instance_data;
         memcpy(&instance_data, *data, sizeof(litexcnc_toolerator_instance_read_data_t));
         *data += sizeof(litexcnc_toolerator_instance_read_data_t);
+        uint32_t status_word = be32toh(instance_data.status);
+        uint32_t queue_status_word = be32toh(instance_data.queue_status);
+        uint8_t status = LITEXCNC_TOOLERATOR_UNPACK(STATUS_STATUS, status_word);
+        bool homed = LITEXCNC_TOOLERATOR_UNPACK(STATUS_HOMED, status_word);
+        uint32_t tool_number = LITEXCNC_TOOLERATOR_UNPACK(STATUS_TOOL_NUMBER, status_word);
+        uint32_t moving_to_tool = LITEXCNC_TOOLERATOR_UNPACK(STATUS_MOVING_TO_TOOL, status_word);
+        // - upper bytes of 16-bit tool numbers
+        if (LITEXCNC_TOOLERATOR_TOOL_WIDTH(instance, i) > 8) {
+            static litexcnc_toolerator_instance_read_data_high_t instance_data_high;
+            memcpy(&instance_data_high, *data, sizeof(litexcnc_toolerator_instance_read_data_high_t));
+            *data += sizeof(litexcnc_toolerator_instance_read_data_high_t);
+            tool_number |= LITEXCNC_TOOLERATOR_UNPACK(STATUS_HIGH_TOOL_NUMBER, be32toh(instance_data_high.status_high)) << 8;
+            moving_to_tool |= LITEXCNC_TOOLERATOR_UNPACK(STATUS_HIGH_MOVING_TO_TOOL, be32toh(instance_data_high.status_high)) << 8;
+        }
+        // - log of state transitions
+        if (instance->data.event_depth) {
+            static litexcnc_toolerator_instance_read_data_events_t instance_data_events;
+            memcpy(&instance_data_events, *data, sizeof(litexcnc_toolerator_instance_read_data_events_t));
+            *data += sizeof(litexcnc_toolerator_instance_read_data_events_t);
+            litexcnc_toolerator_process_events(instance, &instance_data_events);
+        }
+
+        // Convert data to HAL-structure. The state is decoded using the table with the 
+        // flags of each state. When READY and `tool-change` is TRUE, this will set 
+        // `tool-changed` HIGH as well to indicate the toolchange has been finished.
+        uint8_t flags = litexcnc_toolerator_state_flags[status];
+        *(instance->hal.pin.status) = status;
+        *(instance->hal.pin.homing) = (flags & LITEXCNC_TOOLERATOR_FLAG_HOMING) != 0;
+        *(instance->hal.pin.tuning) = (flags & LITEXCNC_TOOLERATOR_FLAG_TUNING) != 0;
+        *(instance->hal.pin.error) = (flags & LITEXCNC_TOOLERATOR_FLAG_ERROR) != 0;
+        *(instance->hal.pin.tool_changed) = 
+            ((flags & LITEXCNC_TOOLERATOR_FLAG_READY) && *(instance->hal.pin.tool_change))
+            || (!(flags & (LITEXCNC_TOOLERATOR_FLAG_READY | LITEXCNC_TOOLERATOR_FLAG_BUSY)) && *(instance->hal.pin.tool_changed));
+        *(instance->hal.pin.homed) = homed;
+        *(instance->hal.pin.current_tool) = litexcnc_toolerator_tool_id(instance, tool_number);
+        *(instance->hal.pin.current_pocket) = tool_number;
+        *(instance->hal.pin.queue_level) = LITEXCNC_TOOLERATOR_UNPACK(QUEUE_STATUS_LEVEL, queue_status_word);
+        *(instance->hal.pin.queue_full) = LITEXCNC_TOOLERATOR_UNPACK(QUEUE_STATUS_FULL, queue_status_word);
+        // Convert the positions from steps to degrees
+        if (instance->data.ppr > 0) {
+            *(instance->hal.pin.position_cmd) = (int32_t) be32toh(instance_data.position) * 360.0 / instance->data.ppr;
+            *(instance->hal.pin.position_fb) = (int32_t) be32toh(instance_data.position_fb) * 360.0 / instance->data.ppr;
+            *(instance->hal.pin.following_error) = *(instance->hal.pin.position_cmd) - *(instance->hal.pin.position_fb);
+            *(instance->hal.pin.drift) = (int32_t) be32toh(instance_data.drift) * 360.0 / instance->data.ppr;
+        }
+        // Result of the tuning, reduced by the safety margin
+        *(instance->hal.pin.tune_passed) = LITEXCNC_TOOLERATOR_UNPACK(TUNE_STATUS_PASSED, be32toh(instance_data.tune_status));
+        *(instance->hal.pin.tune_max_vel) = be32toh(instance_data.tune_max_vel) * (1.0 - instance->hal.param.tune_margin);
+        *(instance->hal.pin.tune_max_acc) = be32toh(instance_data.tune_max_acc) * (1.0 - instance->hal.param.tune_margin);
+        // Keep track of the pocket the turret is locked at, which is stored at exit
+        instance->data.locked = (flags & LITEXCNC_TOOLERATOR_FLAG_READY) && homed;
+        if (instance->data.locked) {
+            instance->data.locked_tool = tool_number;
+        }
+
+        // Trace of the changes of the status and the commands
+        if (toolerator->data.trace != NULL) {
+            litexcnc_toolerator_trace(toolerator, i, status, tool_number, moving_to_tool, period);
+        }
 
-        // Convert data to HAL-structure
-        *(instance->hal.pin.status) = instance_data.status;
-        switch(instance_data.status) {
-            case 0x02:  // HOME_SEARCHING
-            case 0x03:  // HOME_BACK_OFF
-            case 0x04:  // HOME_LATCHING
-            case 0x05:  // HOME_MOVE_TO_ZERO
-                *(instance->hal.pin.homing) = true;
-                *(instance->hal.pin.tool_changed) = false;
+        // Estimate the time remaining until the tool change has been finished. During
+        // the motion, the time elapsed since the start of the motion is subtracted from
+        // the estimate of the complete motion. The elapsed time is reset when homing
+        // starts or when a new index move starts (queued moves follow each other without
+        // a noticeable READY state).
+        if (status != instance->memo.status) {
+            bool homing_started = 
+                (flags & LITEXCNC_TOOLERATOR_FLAG_HOMING) &&
+                !(litexcnc_toolerator_state_flags[instance->memo.status] & LITEXCNC_TOOLERATOR_FLAG_HOMING);
+            if (homing_started 
+                || (status == LITEXCNC_TOOLERATOR_STATE_MOVING_FORWARD)
+                || (status == LITEXCNC_TOOLERATOR_STATE_MOVING_REVERSE)) {
+                instance->data.elapsed = 0;
+            }
+            instance->memo.status = status;
+        }
+        if (instance->data.sequence) {
+            // The duration of the sequence program (waits for inputs, delays) cannot be
+            // estimated, the estimate is not available for these instances
+            *(instance->hal.pin.time_remaining) = 0;
+            continue;
+        }
+        float time_remaining = 0;
+        switch(status) {
+            case LITEXCNC_TOOLERATOR_STATE_START:
+                if ((*(instance->hal.pin.tool_change) || *(instance->hal.pin.home)) && !homed) {
+                    // Homing takes at most a single revolution, after which the turret
+                    // moves from the first tool to the requested tool
+                    time_remaining = 
+                        litexcnc_toolerator_move_time(instance->data.ppr, instance->data.max_vel, instance->data.max_acc)
+                        + litexcnc_toolerator_change_time(instance, 0, litexcnc_toolerator_pocket(instance, *(instance->hal.pin.tool_number)));
+                }
                 break;
-            case 0x06:  // MOVING FORWARD
-            case 0x07:  // MOVING BACKWARD
-                *(instance->hal.pin.tool_changed) = false;
+            case LITEXCNC_TOOLERATOR_STATE_HOME_SEARCHING:
+            case LITEXCNC_TOOLERATOR_STATE_HOME_BACK_OFF:
+            case LITEXCNC_TOOLERATOR_STATE_HOME_LATCHING:
+            case LITEXCNC_TOOLERATOR_STATE_HOME_MOVE_TO_ZERO:
+                instance->data.elapsed += period * 1e-9;
+                time_remaining = 
+                    litexcnc_toolerator_move_time(instance->data.ppr, instance->data.max_vel, instance->data.max_acc)
+                    - instance->data.elapsed;
+                if (time_remaining < 0) time_remaining = 0;
+                if (*(instance->hal.pin.tool_change)) {
+                    time_remaining += litexcnc_toolerator_change_time(instance, 0, litexcnc_toolerator_pocket(instance, *(instance->hal.pin.tool_number)));
+                }
                 break;
-            case 0x08:  // READY
-                // This indicates the toolerator is ready for a new command. When the `toolchange` is
-                // TRUE, this will set `toolchanged` HIGH as well to indicate the toolchange has been
-                // finished.
-                *(instance->hal.pin.tool_changed) = *(instance->hal.pin.tool_change);
+            case LITEXCNC_TOOLERATOR_STATE_MOVING_FORWARD:
+            case LITEXCNC_TOOLERATOR_STATE_MOVING_REVERSE:
+            case LITEXCNC_TOOLERATOR_STATE_MOVING_BACKWARD:
+                instance->data.elapsed += period * 1e-9;
+                time_remaining = 
+                    litexcnc_toolerator_change_time(instance, tool_number, moving_to_tool)
+                    - instance->data.elapsed;
+                break;
+            case LITEXCNC_TOOLERATOR_STATE_READY:
+                if (*(instance->hal.pin.tool_change)) {
+                    time_remaining = litexcnc_toolerator_change_time(instance, tool_number, litexcnc_toolerator_pocket(instance, *(instance->hal.pin.tool_number)));
+                }
                 break;
-            case 0x09:  // ERROR
-                *(instance->hal.pin.tool_changed) = false;
-                *(instance->hal.pin.error) = true;
         }
-        *(instance->hal.pin.homed) = instance_data.homed;
-        *(instance->hal.pin.current_tool) = instance_data.tool_number;
+        *(instance->hal.pin.time_remaining) = (time_remaining > 0) ? time_remaining : 0;
     }
 
     // Move the pointer to the end of the configuration data. This aims at preventing
@@ -302,3 +732,371 @@ int litexcnc_toolerator_process_read(void *module, uint8_t **data, int period) {
     return 0;
 }
 
+
+void litexcnc_toolerator_process_events(litexcnc_toolerator_instance_t *instance, litexcnc_toolerator_instance_read_data_events_t *events) {
+    // The transitions in the data start at the index requested in the previous cycle, 
+    // which is echoed by the FPGA
+    uint32_t status_word = be32toh(events->event_status);
+    uint16_t event_write = LITEXCNC_TOOLERATOR_UNPACK(EVENT_STATUS_WRITE, status_word);
+    uint16_t event_first = LITEXCNC_TOOLERATOR_UNPACK(EVENT_STATUS_READ, status_word);
+    if (!instance->data.event_synced) {
+        // The log in the FPGA keeps running when LinuxCNC is restarted. The transitions
+        // from before the start of the driver are skipped, without counting these as lost
+        instance->data.event_read = event_write;
+        instance->data.event_synced = true;
+        return;
+    }
+    uint16_t available = event_write - event_first;
+    if (available > instance->data.event_depth) {
+        // The oldest transitions have been overwritten, continue with the oldest 
+        // transition still kept in the FPGA in the next cycle
+        *(instance->hal.pin.event_lost) += available - instance->data.event_depth;
+        instance->data.event_read = event_write - instance->data.event_depth;
+        return;
+    }
+    if (available > LITEXCNC_TOOLERATOR_EVENTS_PER_CYCLE) {
+        available = LITEXCNC_TOOLERATOR_EVENTS_PER_CYCLE;
+    }
+    // The time of each transition is reconstructed from the current time, as only the 
+    // lower 32 bits are stored
+    uint32_t time_low = be32toh(events->event_time_low);
+    uint64_t time = ((uint64_t) be32toh(events->event_time_high) << 32) | time_low;
+    for (size_t k=0; k<available; k++) {
+        size_t j = *(instance->hal.pin.event_count) & (LITEXCNC_TOOLERATOR_EVENT_RING - 1);
+        uint32_t event_time = be32toh(events->event[k].time);
+        *(instance->hal.pin.event_state[j]) = LITEXCNC_TOOLERATOR_UNPACK(EVENT_STATE_STATE, be32toh(events->event[k].state));
+        *(instance->hal.pin.event_time[j]) = (time - (uint32_t) (time_low - event_time)) * 1e-6;
+        if (instance->data.ppr > 0) {
+            *(instance->hal.pin.event_position[j]) = (int32_t) be32toh(events->event[k].position) * 360.0 / instance->data.ppr;
+        }
+        *(instance->hal.pin.event_count) += 1;
+    }
+    instance->data.event_read = event_first + available;
+}
+
+
+void litexcnc_toolerator_trace(litexcnc_toolerator_t *toolerator, size_t index, uint8_t status, uint32_t tool_number, uint32_t moving_to_tool, int period) {
+    litexcnc_toolerator_instance_t *instance = &(toolerator->instances[index]);
+    uint8_t inputs = 
+        (*(instance->hal.pin.enable) ? LITEXCNC_TOOLERATOR_TRACE_INPUT_ENABLE : 0)
+        | (*(instance->hal.pin.tool_change) ? LITEXCNC_TOOLERATOR_TRACE_INPUT_TOOL_CHANGE : 0)
+        | (*(instance->hal.pin.home) ? LITEXCNC_TOOLERATOR_TRACE_INPUT_HOME : 0)
+        | (*(instance->hal.pin.tune) ? LITEXCNC_TOOLERATOR_TRACE_INPUT_TUNE : 0)
+        | (*(instance->hal.pin.queue_push) ? LITEXCNC_TOOLERATOR_TRACE_INPUT_QUEUE_PUSH : 0)
+        | (*(instance->hal.pin.queue_clear) ? LITEXCNC_TOOLERATOR_TRACE_INPUT_QUEUE_CLEAR : 0);
+    bool status_changed = (status != instance->memo.status);
+    bool command_changed = (inputs != instance->memo.inputs) || (*(instance->hal.pin.tool_number) != instance->memo.tool_number);
+    if (!status_changed && !command_changed) {
+        return;
+    }
+    instance->memo.inputs = inputs;
+    instance->memo.tool_number = *(instance->hal.pin.tool_number);
+
+    litexcnc_toolerator_trace_record_t record;
+    record.time = rtapi_get_time();
+    record.board = toolerator->data.index;
+    record.instance = index;
+    record.status = status;
+    record.inputs = inputs;
+    record.queue_level = *(instance->hal.pin.queue_level);
+    record.position = *(instance->hal.pin.position_cmd);
+    record.period = period;
+    if (status_changed) {
+        record.type = LITEXCNC_TOOLERATOR_TRACE_STATUS;
+        record.tool = tool_number;
+        record.target = moving_to_tool;
+        litexcnc_toolerator_trace_append(toolerator->data.trace, &record);
+    }
+    if (command_changed) {
+        record.type = LITEXCNC_TOOLERATOR_TRACE_COMMAND;
+        record.tool = *(instance->hal.pin.tool_number);
+        record.target = *(instance->hal.pin.queue_tool_number);
+        litexcnc_toolerator_trace_append(toolerator->data.trace, &record);
+    }
+}
+
+
+int litexcnc_toolerator_trace_init(litexcnc_toolerator_t *toolerator) {
+    // Create the ring in shared memory. The magic is set last, so the reader does not
+    // use the ring before it has been initialised.
+    toolerator->data.trace_shmem_id = rtapi_shmem_new(LITEXCNC_TOOLERATOR_TRACE_KEY + toolerator->data.index, comp_id, sizeof(litexcnc_toolerator_trace_t));
+    if (toolerator->data.trace_shmem_id < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Cannot create the shared memory for the trace\n");
+        return toolerator->data.trace_shmem_id;
+    }
+    litexcnc_toolerator_trace_t *ring;
+    int r = rtapi_shmem_getptr(toolerator->data.trace_shmem_id, (void **) &ring);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Cannot access the shared memory for the trace\n");
+        rtapi_shmem_delete(toolerator->data.trace_shmem_id, comp_id);
+        return r;
+    }
+    memset(ring, 0, sizeof(litexcnc_toolerator_trace_t));
+    ring->size = LITEXCNC_TOOLERATOR_TRACE_RECORDS;
+    ring->record_size = sizeof(litexcnc_toolerator_trace_record_t);
+    __atomic_store_n(&ring->magic, LITEXCNC_TOOLERATOR_TRACE_MAGIC, __ATOMIC_RELEASE);
+    toolerator->data.trace = ring;
+    return 0;
+}
+
+
+void litexcnc_toolerator_trace_append(litexcnc_toolerator_trace_t *ring, litexcnc_toolerator_trace_record_t *record) {
+    // Each board has its own ring, which is only written by the thread running the
+    // read function of that board. The head therefore has a single writer and can be
+    // read directly. The fence makes the previous head visible before the slot is 
+    // overwritten, the release store publishes the record. The reader discards a 
+    // record when the head has reached its slot again after copying it.
+    uint64_t head = ring->head;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring->records[head & (LITEXCNC_TOOLERATOR_TRACE_RECORDS - 1)] = *record;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+int litexcnc_toolerator_record_init(litexcnc_toolerator_t *toolerator, uint8_t *config, size_t config_size) {
+    // Each slot holds the largest frame of this board
+    size_t data_size = required_read_buffer(toolerator);
+    if (required_write_buffer(toolerator) > data_size) {
+        data_size = required_write_buffer(toolerator);
+    }
+    size_t slot_size = LITEXCNC_TOOLERATOR_RECORD_ALIGN(
+        sizeof(litexcnc_toolerator_record_frame_t) 
+        + toolerator->num_instances * sizeof(litexcnc_toolerator_record_inputs_t) 
+        + data_size
+    );
+    size_t size = 
+        sizeof(litexcnc_toolerator_record_t) 
+        + LITEXCNC_TOOLERATOR_RECORD_ALIGN(config_size) 
+        + LITEXCNC_TOOLERATOR_RECORD_SLOTS * slot_size;
+    
+    // Create the ring in shared memory. The magic is set last, so the reader does not
+    // use the ring before it has been initialised.
+    toolerator->data.record_shmem_id = rtapi_shmem_new(LITEXCNC_TOOLERATOR_RECORD_KEY + toolerator->data.index, comp_id, size);
+    if (toolerator->data.record_shmem_id < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Cannot create the shared memory for the recording\n");
+        return toolerator->data.record_shmem_id;
+    }
+    litexcnc_toolerator_record_t *ring;
+    int r = rtapi_shmem_getptr(toolerator->data.record_shmem_id, (void **) &ring);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Cannot access the shared memory for the recording\n");
+        rtapi_shmem_delete(toolerator->data.record_shmem_id, comp_id);
+        return r;
+    }
+    memset(ring, 0, size);
+    ring->slots = LITEXCNC_TOOLERATOR_RECORD_SLOTS;
+    ring->slot_size = slot_size;
+    ring->config_size = config_size;
+    memcpy((uint8_t *) ring + sizeof(litexcnc_toolerator_record_t), config, config_size);
+    __atomic_store_n(&ring->magic, LITEXCNC_TOOLERATOR_RECORD_MAGIC, __ATOMIC_RELEASE);
+    toolerator->data.record = ring;
+    return 0;
+}
+
+
+void litexcnc_toolerator_record(litexcnc_toolerator_t *toolerator, uint32_t type, uint8_t *data, size_t size, int period) {
+    litexcnc_toolerator_record_t *ring = toolerator->data.record;
+
+    // Only the thread of this board changes the head, see litexcnc_toolerator_trace_append()
+    uint64_t head = ring->head;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    uint8_t *slot = 
+        (uint8_t *) ring 
+        + sizeof(litexcnc_toolerator_record_t) 
+        + LITEXCNC_TOOLERATOR_RECORD_ALIGN(ring->config_size)
+        + (head & (LITEXCNC_TOOLERATOR_RECORD_SLOTS - 1)) * ring->slot_size;
+    
+    // Header of the frame
+    litexcnc_toolerator_record_frame_t *frame = (litexcnc_toolerator_record_frame_t *) slot;
+    frame->type = type;
+    frame->period = period;
+    frame->size = size;
+    frame->reserved = 0;
+
+    // The inputs of each instance
+    litexcnc_toolerator_record_inputs_t *inputs = (litexcnc_toolerator_record_inputs_t *) (slot + sizeof(litexcnc_toolerator_record_frame_t));
+    for (size_t i=0; i<toolerator->num_instances; i++) {
+        litexcnc_toolerator_instance_t *instance = &(toolerator->instances[i]);
+        inputs[i].enable = *(instance->hal.pin.enable);
+        inputs[i].home = *(instance->hal.pin.home);
+        inputs[i].tool_change = *(instance->hal.pin.tool_change);
+        inputs[i].queue_push = *(instance->hal.pin.queue_push);
+        inputs[i].queue_clear = *(instance->hal.pin.queue_clear);
+        inputs[i].tune = *(instance->hal.pin.tune);
+        inputs[i].table_write = *(instance->hal.pin.table_write);
+        inputs[i].scope_arm = instance->data.scope ? *(instance->hal.pin.scope_arm) : 0;
+        inputs[i].tool_number = *(instance->hal.pin.tool_number);
+        inputs[i].queue_tool_number = *(instance->hal.pin.queue_tool_number);
+        inputs[i].table_tool = *(instance->hal.pin.table_tool);
+        inputs[i].table_pocket = *(instance->hal.pin.table_pocket);
+        inputs[i].tune_margin = instance->hal.param.tune_margin;
+    }
+
+    // The raw data
+    memcpy(&inputs[toolerator->num_instances], data, size);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+float litexcnc_toolerator_move_time(float distance, float max_vel, float max_acc) {
+    // Safeguard for moves which are not possible
+    if ((distance <= 0) || (max_vel <= 0)) {
+        return 0;
+    }
+    // Without acceleration limits, the move is completed at full speed
+    if (max_acc <= 0) {
+        return distance / max_vel;
+    }
+    // When the distance is too short to reach full speed, the velocity profile is a
+    // triangle. Otherwise the move consists of an acceleration, a part at full speed
+    // and a deceleration.
+    if (distance < max_vel * max_vel / max_acc) {
+        return 2.0f * sqrtf(distance / max_acc);
+    }
+    return distance / max_vel + max_vel / max_acc;
+}
+
+
+float litexcnc_toolerator_change_time(litexcnc_toolerator_instance_t *instance, uint32_t from_tool, uint32_t to_tool) {
+    // Safeguard for instances without tools
+    if (instance->hal.param.tool_count == 0) {
+        return 0;
+    }
+    // Determine the number of pockets to move forward. The firmware only moves when the
+    // commanded tool differs from the current tool. A bidirectional carousel moves in the
+    // shortest direction.
+    uint32_t pockets = 
+        (to_tool % instance->hal.param.tool_count + instance->hal.param.tool_count - from_tool % instance->hal.param.tool_count) 
+        % instance->hal.param.tool_count;
+    if (pockets == 0) {
+        return 0;
+    }
+    if (instance->data.bidirectional && (instance->hal.param.tool_count - pockets < pockets)) {
+        pockets = instance->hal.param.tool_count - pockets;
+    }
+    // The forward move consists of the pockets and the over-travel, afterwards the turret
+    // is moved back over the over-travel to lock the ratchet using the lock profile
+    float distance = (float) pockets * instance->data.ppr / instance->hal.param.tool_count + instance->data.over_travel;
+    return 
+        litexcnc_toolerator_move_time(distance, instance->data.max_vel, instance->data.max_acc)
+        + litexcnc_toolerator_move_time(instance->data.over_travel, instance->data.lock_max_vel, instance->data.lock_max_acc);
+}
+
+
+
+int litexcnc_toolerator_register_board(litexcnc_toolerator_t *toolerator) {
+    // Enlarge the registry when it is full. Memory in the HAL shared memory cannot be 
+    // freed or re-allocated, so the boards are copied to a new array with twice the
+    // capacity. The old array is released when the HAL is closed.
+    if (registry->count >= registry->capacity) {
+        size_t capacity = 2 * registry->capacity;
+        litexcnc_toolerator_t **boards = (litexcnc_toolerator_t **)hal_malloc(capacity * sizeof(litexcnc_toolerator_t *));
+        if (boards == NULL) {
+            LITEXCNC_ERR_NO_DEVICE("Out of memory, cannot register more than %zu boards!\n", registry->capacity);
+            return -ENOMEM;
+        }
+        memcpy(boards, registry->boards, registry->count * sizeof(litexcnc_toolerator_t *));
+        registry->boards = boards;
+        registry->capacity = capacity;
+    }
+    toolerator->data.index = registry->count;
+    registry->boards[registry->count] = toolerator;
+    registry->count++;
+    return 0;
+}
+
+
+void litexcnc_toolerator_restore_state(litexcnc_toolerator_t *toolerator) {
+    // Safeguard when no state file is used
+    if ((state_file == NULL) || (state_file[0] == '\0')) {
+        return;
+    }
+    FILE *file = fopen(state_file, "r");
+    if (file == NULL) {
+        LITEXCNC_PRINT_NO_DEVICE("No toolerator state found in %s\n", state_file);
+        return;
+    }
+    // Each line holds the board, the index of the instance, the fingerprint of its
+    // configuration and the pocket. Lines which cannot be parsed are skipped.
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char fpga_name[HAL_NAME_LEN + 1];
+        uint32_t index, fingerprint, tool;
+        if (sscanf(line, "%47s %" SCNu32 " %" SCNx32 " %" SCNu32, fpga_name, &index, &fingerprint, &tool) != 4) {
+            continue;
+        }
+        if ((strcmp(fpga_name, toolerator->data.fpga_name) != 0) || (index >= toolerator->num_instances)) {
+            continue;
+        }
+        litexcnc_toolerator_instance_t *instance = &(toolerator->instances[index]);
+        if ((fingerprint != instance->data.fingerprint) || (tool >= instance->hal.param.tool_count)) {
+            LITEXCNC_PRINT_NO_DEVICE("Configuration of toolerator %s.%" PRIu32 " changed, state discarded\n", fpga_name, index);
+            continue;
+        }
+        instance->data.restore_valid = true;
+        instance->data.restore_tool = tool;
+        LITEXCNC_PRINT_NO_DEVICE("Toolerator %s.%" PRIu32 " restored at tool %" PRIu32 "\n", fpga_name, index, tool);
+    }
+    fclose(file);
+}
+
+
+void litexcnc_toolerator_save_state(void) {
+    // Safeguard when no state file is used
+    if ((state_file == NULL) || (state_file[0] == '\0') || (registry == NULL)) {
+        return;
+    }
+    FILE *file = fopen(state_file, "w");
+    if (file == NULL) {
+        LITEXCNC_ERR_NO_DEVICE("Cannot write toolerator state to %s\n", state_file);
+        return;
+    }
+    fprintf(file, "# <board> <instance> <fingerprint> <tool>\n");
+    for (size_t i=0; i<registry->count; i++) {
+        litexcnc_toolerator_t *toolerator = registry->boards[i];
+        for (size_t j=0; j<toolerator->num_instances; j++) {
+            litexcnc_toolerator_instance_t *instance = &(toolerator->instances[j]);
+            if (!instance->data.locked) {
+                continue;
+            }
+            fprintf(file, "%s %zu %08" PRIx32 " %u\n", toolerator->data.fpga_name, j, instance->data.fingerprint, instance->data.locked_tool);
+        }
+    }
+    fclose(file);
+}
+
+
+uint32_t litexcnc_toolerator_pocket(litexcnc_toolerator_instance_t *instance, uint32_t tool) {
+    if (!instance->data.carousel) {
+        return tool;
+    }
+    // Tool IDs beyond the table are not in the carousel
+    if (tool >= instance->data.table_size) {
+        return (1 << instance->data.tool_width) - 1;
+    }
+    return instance->data.table[tool];
+}
+
+
+uint32_t litexcnc_toolerator_tool_id(litexcnc_toolerator_instance_t *instance, uint32_t pocket) {
+    if (!instance->data.carousel) {
+        return pocket;
+    }
+    // The commanded tool is preferred when several tool IDs share the pocket
+    uint32_t tool = *(instance->hal.pin.tool_number);
+    if ((tool < instance->data.table_size) && (instance->data.table[tool] == pocket)) {
+        return tool;
+    }
+    // Search the table only when the pocket or the table has changed
+    if (pocket != instance->data.lookup_pocket) {
+        instance->data.lookup_pocket = pocket;
+        instance->data.lookup_tool = (1 << instance->data.tool_width) - 1;
+        for (tool=0; tool<instance->data.table_size; tool++) {
+            if (instance->data.table[tool] == pocket) {
+                instance->data.lookup_tool = tool;
+                break;
+            }
+        }
+    }
+    return instance->data.lookup_tool;
+}
\ No newline at end of file
@@ -36,6 +36,8 @@
 #define __INCLUDE_LITEXCNC_TOOLERATOR_H__
 
 #include <litexcnc.h>
+#include "litexcnc_toolerator_layout.h"
+#include "litexcnc_toolerator_board.h"
 
 #define LITEXCNC_TOOLERATOR_NAME "litexcnc_toolerator"
 
@@ -49,13 +51,44 @@
 #define LITEXCNC_TOOLERATOR_VERSION_PATCH 0
 
 /*******************************************************************************
- * The number of individual instances of this module. NOTE: a module itself can
- * can have any number of individual instances itself. For example, when
- * MAX_INSTANCES is equal to 4 (default), the driver supports up to 4 cards 
- * implementing this module, let's say Stepgen. Each card supports multiple 
- * axis or stepgen instances, which is configured by the module instance.
+ * The initial capacity of the registry of boards implementing this module. NOTE:
+ * a module itself can have any number of individual instances itself. Each card 
+ * supports multiple toolerator instances, which is configured by the module 
+ * instance. The registry grows when more boards are added.
  ******************************************************************************/
-#define MAX_INSTANCES 4
+#define LITEXCNC_TOOLERATOR_INITIAL_BOARDS 4
+
+/*******************************************************************************
+ * Flags describing the states of the toolerator, see litexcnc_toolerator_state_flags
+ ******************************************************************************/
+#define LITEXCNC_TOOLERATOR_FLAG_HOMING 0x01  /** The toolchanger is homing */
+#define LITEXCNC_TOOLERATOR_FLAG_BUSY   0x02  /** The tool change has not been finished, `tool-changed` is reset */
+#define LITEXCNC_TOOLERATOR_FLAG_READY  0x04  /** The toolchanger is ready for a new command */
+#define LITEXCNC_TOOLERATOR_FLAG_ERROR  0x08  /** An error occurred */
+#define LITEXCNC_TOOLERATOR_FLAG_TUNING 0x10  /** The toolchanger is tuning */
+
+/** The number of state transitions kept in the HAL pins (must be a power of 2) */
+#define LITEXCNC_TOOLERATOR_EVENT_RING 8
+
+/*******************************************************************************
+ * The number of instances and the settings of each instance used in the servo-
+ * thread. When the driver is specialised for a board (see 
+ * litexcnc_toolerator_board.h), these are compile-time constants, so the loops 
+ * over the instances are unrolled and the modulo uses a constant divisor.
+ ******************************************************************************/
+#ifdef LITEXCNC_TOOLERATOR_BOARD_INSTANCES
+#define LITEXCNC_TOOLERATOR_NUM_INSTANCES(toolerator) LITEXCNC_TOOLERATOR_BOARD_INSTANCES
+#define LITEXCNC_TOOLERATOR_TOOL_COUNT(instance, index) LITEXCNC_TOOLERATOR_BOARD_TOOL_COUNT(index)
+#define LITEXCNC_TOOLERATOR_TOOL_WIDTH(instance, index) LITEXCNC_TOOLERATOR_BOARD_TOOL_WIDTH(index)
+#define LITEXCNC_TOOLERATOR_CAROUSEL(instance, index) LITEXCNC_TOOLERATOR_BOARD_CAROUSEL(index)
+#define LITEXCNC_TOOLERATOR_UNROLL _Pragma("GCC unroll 16")
+#else
+#define LITEXCNC_TOOLERATOR_NUM_INSTANCES(toolerator) ((toolerator)->num_instances)
+#define LITEXCNC_TOOLERATOR_TOOL_COUNT(instance, index) ((instance)->hal.param.tool_count)
+#define LITEXCNC_TOOLERATOR_TOOL_WIDTH(instance, index) ((instance)->data.tool_width)
+#define LITEXCNC_TOOLERATOR_CAROUSEL(instance, index) ((instance)->data.carousel)
+#define LITEXCNC_TOOLERATOR_UNROLL
+#endif
 
 /** The ID of the component, only used when the component is used as stand-alone */
 int comp_id;
@@ -70,32 +103,197 @@ typedef struct {
         /** Structure defining the HAL pins */
         struct {
             hal_u32_t *status;       /** The raw status from the toolchanger */
-            hal_bit_t *enable;       /** TRUE to enable the toolerator. Will stop motion if set to False. Re-homing is required */
+            hal_bit_t *enable;       /** TRUE to enable the toolerator. Will stop motion if set to False. Re-homing is required, unless the reference is kept (see `homed`). Clears any error */
             hal_bit_t *error;        /** TRUE when an error occurred (at this moment only when homing failed) */
             hal_bit_t *homing;       /** TRUE if the toolchanger is currently homing */
-            hal_bit_t *homed;        /** TRUE if the toolchanger has been homed */
+            hal_bit_t *homed;        /** TRUE if the toolchanger has been homed. Stays TRUE while disabled when the reference is kept and still trusted */
+            hal_bit_t *home;         /** Rising edge starts the homing sequence of the toolchanger */
             hal_bit_t *tool_change;  /** TRUE to start the tool change */
             hal_bit_t *tool_changed; /** TRUE when tool change has been finished */
             hal_u32_t *tool_number;  /** The requested tool number */
-            hal_u32_t *current_tool; /** The current tool in the tool changer */
+            hal_u32_t *current_tool; /** The current tool in the tool changer (tool ID in carousel mode, all ones when no tool ID is in the pocket) */
+            hal_u32_t *current_pocket; /** The pocket at the tool position, equal to `current-tool` except in carousel mode */
+            hal_u32_t *queue_tool_number; /** The tool number to be added to the command queue */
+            hal_bit_t *queue_push;   /** Rising edge adds `queue-tool-number` to the command queue */
+            hal_bit_t *queue_clear;  /** TRUE to discard all tools waiting in the command queue */
+            hal_u32_t *queue_level;  /** The number of tools waiting in the command queue */
+            hal_bit_t *queue_full;   /** TRUE when the command queue cannot accept more tools */
+            hal_float_t *time_remaining; /** Estimated time (in seconds) until the tool change has finished, 0 with a sequence program */
+            hal_float_t *position_cmd;   /** The position (in degrees) of the stepgen */
+            hal_float_t *position_fb;    /** The position (in degrees) measured by the encoder, equal to `position-cmd` without encoder */
+            hal_float_t *following_error; /** The difference (in degrees) between `position-cmd` and `position-fb` */
+            hal_float_t *drift;          /** The difference (in degrees) between the home switch found at the last pass and the reference */
+            hal_bit_t *tune;             /** Rising edge starts tuning of the speed and acceleration (the toolchanger must be homed) */
+            hal_bit_t *tuning;           /** TRUE while the toolchanger is tuning */
+            hal_u32_t *tune_passed;      /** The number of trial revolutions passed during tuning */
+            hal_float_t *tune_max_vel;   /** The tuned maximum speed (in steps per second), including the safety margin */
+            hal_float_t *tune_max_acc;   /** The tuned maximum acceleration (in steps per second squared), including the safety margin */
+            hal_bit_t *scope_arm;        /** Rising edge arms the capture of the trajectory, which starts at the next move or homing */
+            hal_u32_t *table_tool;       /** Carousel mode: the tool ID of the entry to write to the tool table */
+            hal_u32_t *table_pocket;     /** Carousel mode: the pocket of the tool */
+            hal_bit_t *table_write;      /** Carousel mode: rising edge writes the entry to the tool table */
+            hal_u32_t *event_count;      /** The number of state transitions read from the FPGA */
+            hal_u32_t *event_lost;       /** The number of state transitions overwritten before these were read */
+            hal_u32_t *event_state[LITEXCNC_TOOLERATOR_EVENT_RING];      /** The state entered, entry `event-count - 1` is the last transition */
+            hal_float_t *event_time[LITEXCNC_TOOLERATOR_EVENT_RING];     /** Time (in seconds since the FPGA has started) of the transition */
+            hal_float_t *event_position[LITEXCNC_TOOLERATOR_EVENT_RING]; /** The position (in degrees) of the stepgen at the transition */
         } pin;
 
         /** Structure defining the HAL params */
         struct {
             hal_u32_t tool_count;   /** The (maximum) number of tools in the toolchanger */
+            hal_float_t tune_margin; /** The fraction by which the tuned speed and acceleration are reduced (default 0.2) */
         } param;
     } hal;
 
     // This struct holds all old values from previous cycle (memoization) 
     struct {
+        hal_bit_t queue_push;  /** Value of the `queue-push` pin in the previous cycle */
+        hal_bit_t table_write; /** Value of the `table-write` pin in the previous cycle */
+        uint8_t status;        /** The status of the toolchanger in the previous cycle */
+        uint8_t inputs;        /** The commands in the previous cycle, see LITEXCNC_TOOLERATOR_TRACE_INPUT_* */
+        uint32_t tool_number;  /** The requested tool number in the previous cycle */
     } memo;
 
     // This struct contains data, both calculated and direct received from the FPGA
     struct {        
+        uint8_t queue_toggle;  /** Toggled for each tool pushed to the command queue */
+        uint8_t table_toggle;  /** Toggled for each entry written to the tool table */
+        bool carousel;         /** TRUE when the tool number is a tool ID (carousel mode) */
+        bool bidirectional;    /** TRUE when the carousel moves in the shortest direction */
+        bool scope;            /** TRUE when the trajectory of the stepgen can be captured */
+        bool sequence;         /** TRUE when tool changes run the sequence program */
+        uint8_t tool_width;    /** The width (in bits) of the tool numbers exchanged with the FPGA */
+        uint32_t table_size;   /** The number of tool IDs in the tool table (carousel mode only) */
+        uint16_t *table;       /** The pocket of each tool ID, copy of the tool table in the FPGA */
+        uint32_t lookup_pocket; /** The pocket of the last search for its tool ID in the table */
+        uint32_t lookup_tool;  /** The first tool ID in the table at `lookup_pocket` */
+        uint32_t ppr;          /** The number of pulses per revolution */
+        uint32_t over_travel;  /** The over-travel in steps */
+        float max_vel;         /** The maximum speed in steps per second */
+        float max_acc;         /** The maximum acceleration in steps per second squared */
+        float lock_max_vel;    /** The maximum speed of the lock move in steps per second */
+        float lock_max_acc;    /** The maximum acceleration of the lock move in steps per second squared */
+        float elapsed;         /** Time (in seconds) elapsed since the current motion started */
+        uint32_t fingerprint;  /** Checksum of the configuration of the instance */
+        bool restore_valid;    /** TRUE when a pocket has been restored from the state file */
+        uint16_t restore_tool; /** The pocket restored from the state file */
+        bool locked;           /** TRUE when the turret is homed and locked at a pocket */
+        uint16_t locked_tool;  /** The pocket the turret was last locked at */
+        uint16_t event_depth;  /** The number of state transitions kept in the FPGA (0 when disabled) */
+        uint16_t event_read;   /** The index of the next state transition to be read from the FPGA */
+        bool event_synced;     /** TRUE when `event_read` has been synchronised with the FPGA */
     } data;
 } litexcnc_toolerator_instance_t;
 
 
+/*******************************************************************************
+ * Trace of the toolerators. Each board appends a record to its own ring buffer in
+ * shared memory for each change of the status and of the commands of a toolerator.
+ * The key of the ring is LITEXCNC_TOOLERATOR_TRACE_KEY plus the index of the board,
+ * so boards read in different HAL-threads never write to the same ring. Each ring has
+ * a single writer (the thread running the read function of the board) and a single 
+ * reader, which only reads. When the ring is full, the oldest records are overwritten:
+ * the reader compares its position with `head` to detect lost records. The trace is 
+ * read with `litexcnc-toolerator-trace`, the key and layout must be equal to this tool.
+ ******************************************************************************/
+#define LITEXCNC_TOOLERATOR_TRACE_KEY     0x54524143  /** Key of the shared memory */
+#define LITEXCNC_TOOLERATOR_TRACE_MAGIC   0x54524331  /** Set when the ring has been initialised */
+#define LITEXCNC_TOOLERATOR_TRACE_RECORDS 4096        /** The number of records in the ring (must be a power of 2) */
+
+/** Types of the records */
+#define LITEXCNC_TOOLERATOR_TRACE_STATUS  0x01  /** The status of the toolerator has changed */
+#define LITEXCNC_TOOLERATOR_TRACE_COMMAND 0x02  /** The commands to the toolerator have changed */
+
+/** The commands stored in the field `inputs` of the records */
+#define LITEXCNC_TOOLERATOR_TRACE_INPUT_ENABLE      0x01
+#define LITEXCNC_TOOLERATOR_TRACE_INPUT_TOOL_CHANGE 0x02
+#define LITEXCNC_TOOLERATOR_TRACE_INPUT_HOME        0x04
+#define LITEXCNC_TOOLERATOR_TRACE_INPUT_TUNE        0x08
+#define LITEXCNC_TOOLERATOR_TRACE_INPUT_QUEUE_PUSH  0x10
+#define LITEXCNC_TOOLERATOR_TRACE_INPUT_QUEUE_CLEAR 0x20
+
+// A single record of the trace (32 bytes)
+typedef struct {
+    uint64_t time;         /** Time (in nano-seconds) of the cycle, see rtapi_get_time() */
+    uint16_t board;        /** The index of the board in the registry */
+    uint16_t instance;     /** The index of the toolerator on the board */
+    uint8_t type;          /** The type of the record, see LITEXCNC_TOOLERATOR_TRACE_* */
+    uint8_t status;        /** The status of the toolerator */
+    uint8_t inputs;        /** The commands, see LITEXCNC_TOOLERATOR_TRACE_INPUT_* */
+    uint8_t queue_level;   /** The number of tools waiting in the command queue */
+    uint32_t tool;         /** Status: the current tool, command: the requested tool number */
+    uint32_t target;       /** Status: the tool moving to, command: the tool number for the queue */
+    float position;        /** The position (in degrees) of the stepgen */
+    uint32_t period;       /** Period (in nano-seconds) of the servo-thread */
+} litexcnc_toolerator_trace_record_t;
+
+// Ring buffer with the trace, allocated in shared memory
+typedef struct {
+    uint32_t magic;        /** Equal to LITEXCNC_TOOLERATOR_TRACE_MAGIC when initialised */
+    uint32_t size;         /** The number of records in the ring */
+    uint32_t record_size;  /** The size (in bytes) of a single record */
+    uint32_t reserved;
+    uint64_t head;         /** The number of records written, only changed by the thread of the board */
+    litexcnc_toolerator_trace_record_t records[LITEXCNC_TOOLERATOR_TRACE_RECORDS];
+} litexcnc_toolerator_trace_t;
+
+
+/*******************************************************************************
+ * Recording of the cycles of a board. In record mode, the driver copies the config
+ * block at start-up and the inputs and the raw data exchanged with the FPGA of each
+ * cycle to a ring buffer in shared memory (one per board). The ring is written to a
+ * log by `litexcnc-toolerator-record` and the log is fed back through the driver by
+ * the replay harness in `tools/replay`. The ring has a single writer and a single 
+ * reader, like the trace; when the ring is full the oldest frame is overwritten.
+ ******************************************************************************/
+#define LITEXCNC_TOOLERATOR_RECORD_KEY    0x52454330  /** Key of the shared memory of the first board, incremented per board */
+#define LITEXCNC_TOOLERATOR_RECORD_MAGIC  0x52454331  /** Set when the ring has been initialised */
+#define LITEXCNC_TOOLERATOR_RECORD_SLOTS  1024        /** The number of frames in the ring (must be a power of 2) */
+
+/** Types of the frames */
+#define LITEXCNC_TOOLERATOR_RECORD_READ   0x01  /** Data read from the FPGA, before it is processed */
+#define LITEXCNC_TOOLERATOR_RECORD_WRITE  0x02  /** Data written to the FPGA */
+
+// The inputs of a single instance at the start of a function (32 bytes)
+typedef struct {
+    uint8_t enable;
+    uint8_t home;
+    uint8_t tool_change;
+    uint8_t queue_push;
+    uint8_t queue_clear;
+    uint8_t tune;
+    uint8_t table_write;
+    uint8_t scope_arm;
+    uint32_t tool_number;
+    uint32_t queue_tool_number;
+    uint32_t table_tool;
+    uint32_t table_pocket;
+    double tune_margin;
+} litexcnc_toolerator_record_inputs_t;
+
+// Header of a frame, followed by the inputs of each instance and the raw data
+typedef struct {
+    uint32_t type;         /** The type of the frame, see LITEXCNC_TOOLERATOR_RECORD_* */
+    int32_t period;        /** Period (in nano-seconds) of the cycle */
+    uint32_t size;         /** The size (in bytes) of the raw data */
+    uint32_t reserved;
+} litexcnc_toolerator_record_frame_t;
+
+// Ring buffer with the recorded frames, allocated in shared memory. The header is 
+// followed by the config block (padded to 8 bytes) and the slots with the frames.
+typedef struct {
+    uint32_t magic;        /** Equal to LITEXCNC_TOOLERATOR_RECORD_MAGIC when initialised */
+    uint32_t slots;        /** The number of slots in the ring */
+    uint32_t slot_size;    /** The size (in bytes) of a single slot */
+    uint32_t config_size;  /** The size (in bytes) of the config block */
+    uint64_t head;         /** The number of frames written, only changed by the thread of the board */
+} litexcnc_toolerator_record_t;
+
+/** Rounds the size up to a multiple of 8 bytes, the alignment of the slots */
+#define LITEXCNC_TOOLERATOR_RECORD_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+
+
 // Defines the toolerator, contains a collection of toolerator instances
 typedef struct {
     // Collection of instances
@@ -123,6 +321,11 @@ typedef struct {
     // of the FPGA, consider adding pointers to that data)
     struct {
         char *fpga_name;
+        uint16_t index;    /** The index of the board in the registry */
+        litexcnc_toolerator_record_t *record;  /** Ring with the recorded frames, NULL when not recording */
+        int record_shmem_id;
+        litexcnc_toolerator_trace_t *trace;    /** Ring with the trace, NULL when the trace is disabled */
+        int trace_shmem_id;
         uint32_t *clock_frequency;
         float *clock_frequency_recip;
         uint64_t *wallclock_ticks;
@@ -131,40 +334,53 @@ typedef struct {
 
 } litexcnc_toolerator_t;
 
+
+// Registry of all boards implementing this module, allocated in HAL shared memory
+typedef struct {
+    size_t capacity;                   /** The number of boards which fit in the registry */
+    size_t count;                      /** The number of boards in the registry */
+    litexcnc_toolerator_t **boards;    /** The toolerator module of each board */
+} litexcnc_toolerator_registry_t;
+
 /*******************************************************************************
  * DATAPACKAGES
  * NOTE: The order of these package MUST coincide with the order in the MMIO 
  * definition. The driver MUST consume exactly the number of bytes as defined
  * by the firmware to prevent issues with data alignment.
  ******************************************************************************/
-// - CONFIG DATA
-// Defines the data-package for sending the settings for a single module. 
+// - INIT DATA
+// Defines the header of the config block, which holds the number of instances, the
+// size (in bytes) of the data of each instance and the checksum of the layout of the
+// registers. The data of each instance follows the header.
 #pragma pack(push, 4)
 typedef struct {
-
-} litexcnc_toolerator_config_data_t;
+    uint16_t instances;
+    uint16_t record_size;
+    uint32_t layout_hash;
+} litexcnc_toolerator_init_header_t;
 #pragma pack(pop)
 
-// WRITE DATA
-#pragma pack(push,4)
+// Defines the data-package with the motion settings of a single instance, which is
+// read from the FPGA when the driver is initialised. When the firmware sends more data
+// per instance, the remainder is skipped. Less data is refused, as the settings (for
+// example the tool count) cannot be defaulted.
+#pragma pack(push, 4)
 typedef struct {
-    uint8_t padding;
-    uint8_t enable;
-    uint8_t tool_change;
-    uint8_t tool_number;
-} litexcnc_toolerator_instance_write_data_t;
+    uint32_t ppr;
+    uint32_t over_travel;
+    uint32_t max_vel;
+    uint32_t max_acc;
+    uint32_t lock_max_vel;
+    uint32_t lock_max_acc;
+    uint32_t fingerprint;
+    uint32_t mode;
+    uint32_t tools;
+} litexcnc_toolerator_instance_init_data_t;
 #pragma pack(pop)
 
-// READ DATA
-// - instance data
-#pragma pack(push,4)
-typedef struct {
-    uint8_t padding;
-    uint8_t tool_number;
-    uint8_t homed;
-    uint8_t status;
-} litexcnc_toolerator_instance_read_data_t;
-#pragma pack(pop)
+// - CONFIG, WRITE AND READ DATA
+// The data-packages written in the first cycle and exchanged every cycle are generated
+// from the layout of the registers in the firmware, see litexcnc_toolerator_layout.h.
 
 
 /*******************************************************************************
@@ -260,4 +476,148 @@ int litexcnc_toolerator_prepare_write(void *instance, uint8_t **data, int period
  ******************************************************************************/
 int litexcnc_toolerator_process_read(void *instance, uint8_t** data, int period);
 
+
+/*******************************************************************************
+ * Copies the state transitions read from the FPGA to the HAL pins and determines
+ * the first transition to be read in the next cycle. Transitions which have been
+ * overwritten in the FPGA are counted in `event-lost`.
+ *
+ * @param instance The toolerator instance
+ * @param events The data received from the FPGA
+ ******************************************************************************/
+void litexcnc_toolerator_process_events(litexcnc_toolerator_instance_t *instance, litexcnc_toolerator_instance_read_data_events_t *events);
+
+
+/*******************************************************************************
+ * Estimates the time required for a move, starting and ending at standstill. The
+ * estimate is based on a trapezoidal velocity profile.
+ *
+ * @param distance The distance to move (in steps)
+ * @param max_vel The maximum speed (in steps per second)
+ * @param max_acc The maximum acceleration (in steps per second squared). When 0,
+ *     the acceleration is not limited.
+ ******************************************************************************/
+float litexcnc_toolerator_move_time(float distance, float max_vel, float max_acc);
+
+
+/*******************************************************************************
+ * Estimates the time required for a complete tool change, including the
+ * over-travel to lock the ratchet and the move back to the lock position.
+ *
+ * @param instance The toolerator instance
+ * @param from_tool The tool the toolchanger starts at
+ * @param to_tool The tool the toolchanger moves to
+ ******************************************************************************/
+float litexcnc_toolerator_change_time(litexcnc_toolerator_instance_t *instance, uint32_t from_tool, uint32_t to_tool);
+
+
+/*******************************************************************************
+ * Returns the pocket of the given tool. In carousel mode, the pocket is looked up
+ * in the copy of the tool table, otherwise the tool number is the pocket.
+ *
+ * @param instance The toolerator instance
+ * @param tool The tool number (tool ID in carousel mode)
+ ******************************************************************************/
+uint32_t litexcnc_toolerator_pocket(litexcnc_toolerator_instance_t *instance, uint32_t tool);
+
+
+/*******************************************************************************
+ * Returns the tool ID in the given pocket, the reverse of litexcnc_toolerator_pocket.
+ * The commanded tool is preferred when several tool IDs share the pocket; when no
+ * tool ID is in the pocket, all bits of the tool width are set.
+ *
+ * @param instance The toolerator instance
+ * @param pocket The pocket
+ ******************************************************************************/
+uint32_t litexcnc_toolerator_tool_id(litexcnc_toolerator_instance_t *instance, uint32_t pocket);
+
+
+/*******************************************************************************
+ * Adds the toolerator module of a board to the registry. When the registry is full,
+ * its capacity is doubled. 
+ *
+ * @param toolerator The toolerator module of the board
+ * @return 0 on success, -ENOMEM when the registry could not be enlarged
+ ******************************************************************************/
+int litexcnc_toolerator_register_board(litexcnc_toolerator_t *toolerator);
+
+
+/*******************************************************************************
+ * Restores the pockets the turrets of the given board were locked at in the
+ * previous run from the state file. A pocket is only restored when the
+ * fingerprint of the configuration has not been changed.
+ *
+ * @param toolerator The toolerator module of the board
+ ******************************************************************************/
+void litexcnc_toolerator_restore_state(litexcnc_toolerator_t *toolerator);
+
+
+/*******************************************************************************
+ * Saves the pockets the turrets of all boards are locked at to the state file. 
+ * Turrets which are not locked at a pocket (i.e. without reference or moving) 
+ * are not saved.
+ ******************************************************************************/
+void litexcnc_toolerator_save_state(void);
+
+
+/*******************************************************************************
+ * Appends records to the trace for the changes of the status and the commands of
+ * a toolerator since the previous cycle. Never blocks; when the ring is full, the
+ * oldest record is overwritten.
+ *
+ * @param toolerator The toolerator module of the board
+ * @param index The index of the instance on the board
+ * @param status The status received from the FPGA
+ * @param tool_number The current tool received from the FPGA
+ * @param moving_to_tool The tool the toolchanger is moving to
+ * @param period Period in nano-seconds of a cycle
+ ******************************************************************************/
+void litexcnc_toolerator_trace(litexcnc_toolerator_t *toolerator, size_t index, uint8_t status, uint32_t tool_number, uint32_t moving_to_tool, int period);
+
+
+/*******************************************************************************
+ * Creates the ring with the trace of the board in shared memory, with the key 
+ * LITEXCNC_TOOLERATOR_TRACE_KEY plus the index of the board. The board must have 
+ * been registered.
+ *
+ * @param toolerator The toolerator module of the board
+ ******************************************************************************/
+int litexcnc_toolerator_trace_init(litexcnc_toolerator_t *toolerator);
+
+
+/*******************************************************************************
+ * Appends a single record to the trace of a board, overwriting the oldest record 
+ * when the ring is full. Must only be called from the thread of the board.
+ *
+ * @param ring The ring with the trace of the board
+ * @param record The record to append
+ ******************************************************************************/
+void litexcnc_toolerator_trace_append(litexcnc_toolerator_trace_t *ring, litexcnc_toolerator_trace_record_t *record);
+
+
+/*******************************************************************************
+ * Creates the ring for the recording of a board in shared memory and copies the
+ * config block to it. 
+ *
+ * @param toolerator The toolerator module of the board
+ * @param config Pointer to the start of the config block
+ * @param config_size The size (in bytes) of the config block
+ * @return 0 on success, a negative error code when the ring could not be created
+ ******************************************************************************/
+int litexcnc_toolerator_record_init(litexcnc_toolerator_t *toolerator, uint8_t *config, size_t config_size);
+
+
+/*******************************************************************************
+ * Appends a frame with the inputs of all instances and the raw data to the ring
+ * of the board. Never blocks; when the ring is full, the oldest frame is 
+ * overwritten.
+ *
+ * @param toolerator The toolerator module of the board
+ * @param type The type of the frame, see LITEXCNC_TOOLERATOR_RECORD_*
+ * @param data The raw data exchanged with the FPGA
+ * @param size The size (in bytes) of the raw data
+ * @param period Period in nano-seconds of a cycle
+ ******************************************************************************/
+void litexcnc_toolerator_record(litexcnc_toolerator_t *toolerator, uint32_t type, uint8_t *data, size_t size, int period);
+
 #endif
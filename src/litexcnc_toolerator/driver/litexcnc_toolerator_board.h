@@ -0,0 +1,12 @@
+/********************************************************************
+* Description:  litexcnc_toolerator_board.h
+*               Settings of the board the driver is specialised for
+*
+* Generated by litexcnc_toolerator.config.toolerator, do not edit. Run
+* python -m litexcnc_toolerator.config.toolerator to specialise the
+* driver for a board.
+********************************************************************/
+#ifndef __INCLUDE_LITEXCNC_TOOLERATOR_BOARD_H__
+#define __INCLUDE_LITEXCNC_TOOLERATOR_BOARD_H__
+
+#endif
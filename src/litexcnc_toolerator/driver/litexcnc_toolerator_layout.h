@@ -0,0 +1,190 @@
+/********************************************************************
+* Description:  litexcnc_toolerator_layout.h
+*               Layout of the registers of the toolerator
+*
+* Generated by litexcnc_toolerator.config.layout, do not edit. Run
+* python -m litexcnc_toolerator.config.layout --write after changing
+* the layout.
+********************************************************************/
+#ifndef __INCLUDE_LITEXCNC_TOOLERATOR_LAYOUT_H__
+#define __INCLUDE_LITEXCNC_TOOLERATOR_LAYOUT_H__
+
+/** Checksum of the layout, must be equal to the checksum in the config block */
+#define LITEXCNC_TOOLERATOR_LAYOUT_HASH 0x6FED7AF4
+
+/** The states of the toolerator */
+#define LITEXCNC_TOOLERATOR_STATE_START 0x01
+#define LITEXCNC_TOOLERATOR_STATE_HOME_SEARCHING 0x02
+#define LITEXCNC_TOOLERATOR_STATE_HOME_BACK_OFF 0x03
+#define LITEXCNC_TOOLERATOR_STATE_HOME_LATCHING 0x04
+#define LITEXCNC_TOOLERATOR_STATE_HOME_MOVE_TO_ZERO 0x05
+#define LITEXCNC_TOOLERATOR_STATE_MOVING_FORWARD 0x06
+#define LITEXCNC_TOOLERATOR_STATE_MOVING_BACKWARD 0x07
+#define LITEXCNC_TOOLERATOR_STATE_READY 0x08
+#define LITEXCNC_TOOLERATOR_STATE_ERROR 0x09
+#define LITEXCNC_TOOLERATOR_STATE_TUNING 0x0A
+#define LITEXCNC_TOOLERATOR_STATE_SEQUENCING 0x0B
+#define LITEXCNC_TOOLERATOR_STATE_MOVING_REVERSE 0x0C
+/** The number of values the status field can hold */
+#define LITEXCNC_TOOLERATOR_STATE_COUNT 16
+
+/** The number of state transitions read each cycle */
+#define LITEXCNC_TOOLERATOR_EVENTS_PER_CYCLE 4
+
+/** Packs a value in the given field of a register (host byte order) */
+#define LITEXCNC_TOOLERATOR_PACK(field, value) \
+    ((((uint32_t) (value)) << LITEXCNC_TOOLERATOR_##field##_SHIFT) & LITEXCNC_TOOLERATOR_##field##_MASK)
+/** Extracts the given field from a register (host byte order) */
+#define LITEXCNC_TOOLERATOR_UNPACK(field, word) \
+    ((((uint32_t) (word)) & LITEXCNC_TOOLERATOR_##field##_MASK) >> LITEXCNC_TOOLERATOR_##field##_SHIFT)
+
+/** Fields of the config data registers */
+#define LITEXCNC_TOOLERATOR_RESTORE_TOOL_NUMBER_SHIFT 0
+#define LITEXCNC_TOOLERATOR_RESTORE_TOOL_NUMBER_MASK 0x0000FFFFu
+#define LITEXCNC_TOOLERATOR_RESTORE_VALID_SHIFT 16
+#define LITEXCNC_TOOLERATOR_RESTORE_VALID_MASK 0x00010000u
+
+/** Fields of the write data registers */
+#define LITEXCNC_TOOLERATOR_DATA_TOOL_NUMBER_SHIFT 0
+#define LITEXCNC_TOOLERATOR_DATA_TOOL_NUMBER_MASK 0x000000FFu
+#define LITEXCNC_TOOLERATOR_DATA_TOOL_CHANGE_SHIFT 8
+#define LITEXCNC_TOOLERATOR_DATA_TOOL_CHANGE_MASK 0x00000100u
+#define LITEXCNC_TOOLERATOR_DATA_ENABLED_SHIFT 16
+#define LITEXCNC_TOOLERATOR_DATA_ENABLED_MASK 0x00010000u
+#define LITEXCNC_TOOLERATOR_DATA_HOME_SHIFT 24
+#define LITEXCNC_TOOLERATOR_DATA_HOME_MASK 0x01000000u
+#define LITEXCNC_TOOLERATOR_QUEUE_DATA_TOOL_NUMBER_SHIFT 0
+#define LITEXCNC_TOOLERATOR_QUEUE_DATA_TOOL_NUMBER_MASK 0x000000FFu
+#define LITEXCNC_TOOLERATOR_QUEUE_DATA_PUSH_SHIFT 8
+#define LITEXCNC_TOOLERATOR_QUEUE_DATA_PUSH_MASK 0x00000100u
+#define LITEXCNC_TOOLERATOR_QUEUE_DATA_CLEAR_SHIFT 16
+#define LITEXCNC_TOOLERATOR_QUEUE_DATA_CLEAR_MASK 0x00010000u
+#define LITEXCNC_TOOLERATOR_TUNE_DATA_TUNE_SHIFT 0
+#define LITEXCNC_TOOLERATOR_TUNE_DATA_TUNE_MASK 0x00000001u
+#define LITEXCNC_TOOLERATOR_TUNE_DATA_SCOPE_ARM_SHIFT 8
+#define LITEXCNC_TOOLERATOR_TUNE_DATA_SCOPE_ARM_MASK 0x00000100u
+#define LITEXCNC_TOOLERATOR_TABLE_DATA_TOOL_SHIFT 0
+#define LITEXCNC_TOOLERATOR_TABLE_DATA_TOOL_MASK 0x000000FFu
+#define LITEXCNC_TOOLERATOR_TABLE_DATA_POCKET_SHIFT 8
+#define LITEXCNC_TOOLERATOR_TABLE_DATA_POCKET_MASK 0x0000FF00u
+#define LITEXCNC_TOOLERATOR_TABLE_DATA_WRITE_SHIFT 16
+#define LITEXCNC_TOOLERATOR_TABLE_DATA_WRITE_MASK 0x00010000u
+
+/** Fields of the write data high registers */
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_TOOL_NUMBER_SHIFT 0
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_TOOL_NUMBER_MASK 0x000000FFu
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_QUEUE_TOOL_NUMBER_SHIFT 8
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_QUEUE_TOOL_NUMBER_MASK 0x0000FF00u
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_TABLE_TOOL_SHIFT 16
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_TABLE_TOOL_MASK 0x00FF0000u
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_TABLE_POCKET_SHIFT 24
+#define LITEXCNC_TOOLERATOR_DATA_HIGH_TABLE_POCKET_MASK 0xFF000000u
+
+/** Fields of the write data events registers */
+#define LITEXCNC_TOOLERATOR_EVENT_DATA_READ_SHIFT 0
+#define LITEXCNC_TOOLERATOR_EVENT_DATA_READ_MASK 0x0000FFFFu
+
+/** Fields of the read data registers */
+#define LITEXCNC_TOOLERATOR_STATUS_STATUS_SHIFT 0
+#define LITEXCNC_TOOLERATOR_STATUS_STATUS_MASK 0x0000000Fu
+#define LITEXCNC_TOOLERATOR_STATUS_HOMED_SHIFT 8
+#define LITEXCNC_TOOLERATOR_STATUS_HOMED_MASK 0x00000100u
+#define LITEXCNC_TOOLERATOR_STATUS_TOOL_NUMBER_SHIFT 16
+#define LITEXCNC_TOOLERATOR_STATUS_TOOL_NUMBER_MASK 0x00FF0000u
+#define LITEXCNC_TOOLERATOR_STATUS_MOVING_TO_TOOL_SHIFT 24
+#define LITEXCNC_TOOLERATOR_STATUS_MOVING_TO_TOOL_MASK 0xFF000000u
+#define LITEXCNC_TOOLERATOR_QUEUE_STATUS_LEVEL_SHIFT 0
+#define LITEXCNC_TOOLERATOR_QUEUE_STATUS_LEVEL_MASK 0x000000FFu
+#define LITEXCNC_TOOLERATOR_QUEUE_STATUS_FULL_SHIFT 8
+#define LITEXCNC_TOOLERATOR_QUEUE_STATUS_FULL_MASK 0x00000100u
+#define LITEXCNC_TOOLERATOR_TUNE_STATUS_PASSED_SHIFT 0
+#define LITEXCNC_TOOLERATOR_TUNE_STATUS_PASSED_MASK 0x000000FFu
+
+/** Fields of the read data high registers */
+#define LITEXCNC_TOOLERATOR_STATUS_HIGH_TOOL_NUMBER_SHIFT 0
+#define LITEXCNC_TOOLERATOR_STATUS_HIGH_TOOL_NUMBER_MASK 0x000000FFu
+#define LITEXCNC_TOOLERATOR_STATUS_HIGH_MOVING_TO_TOOL_SHIFT 8
+#define LITEXCNC_TOOLERATOR_STATUS_HIGH_MOVING_TO_TOOL_MASK 0x0000FF00u
+
+/** Fields of the read data events registers */
+#define LITEXCNC_TOOLERATOR_EVENT_STATUS_WRITE_SHIFT 0
+#define LITEXCNC_TOOLERATOR_EVENT_STATUS_WRITE_MASK 0x0000FFFFu
+#define LITEXCNC_TOOLERATOR_EVENT_STATUS_READ_SHIFT 16
+#define LITEXCNC_TOOLERATOR_EVENT_STATUS_READ_MASK 0xFFFF0000u
+
+/** Fields of the registers of a single state transition */
+#define LITEXCNC_TOOLERATOR_EVENT_STATE_STATE_SHIFT 0
+#define LITEXCNC_TOOLERATOR_EVENT_STATE_STATE_MASK 0x0000000Fu
+
+/** Data-package with a single state transition */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t state;
+    uint32_t time;
+    uint32_t position;
+} litexcnc_toolerator_event_data_t;
+#pragma pack(pop)
+
+/** Data-package with the config data of a single instance */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t restore;
+} litexcnc_toolerator_instance_config_data_t;
+#pragma pack(pop)
+
+/** Data-package with the write data of a single instance */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t data;
+    uint32_t queue_data;
+    uint32_t tune_data;
+    uint32_t table_data;
+} litexcnc_toolerator_instance_write_data_t;
+#pragma pack(pop)
+
+/** Data-package with the write data high of a single instance */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t data_high;
+} litexcnc_toolerator_instance_write_data_high_t;
+#pragma pack(pop)
+
+/** Data-package with the write data events of a single instance */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t event_data;
+} litexcnc_toolerator_instance_write_data_events_t;
+#pragma pack(pop)
+
+/** Data-package with the read data of a single instance */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t status;
+    uint32_t queue_status;
+    uint32_t position;
+    uint32_t position_fb;
+    uint32_t drift;
+    uint32_t tune_status;
+    uint32_t tune_max_vel;
+    uint32_t tune_max_acc;
+} litexcnc_toolerator_instance_read_data_t;
+#pragma pack(pop)
+
+/** Data-package with the read data high of a single instance */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t status_high;
+} litexcnc_toolerator_instance_read_data_high_t;
+#pragma pack(pop)
+
+/** Data-package with the read data events of a single instance */
+#pragma pack(push, 4)
+typedef struct {
+    uint32_t event_status;
+    uint32_t event_time_high;
+    uint32_t event_time_low;
+    litexcnc_toolerator_event_data_t event[LITEXCNC_TOOLERATOR_EVENTS_PER_CYCLE];
+} litexcnc_toolerator_instance_read_data_events_t;
+#pragma pack(pop)
+
+#endif
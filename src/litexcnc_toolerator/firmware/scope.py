@@ -0,0 +1,156 @@
+"""
+Turret style tool changer driven by stepper motor
+
+Author: Peter van Tol <petertgvantol@gmail.com>
+License: GPL Version 2
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of version 2 of the GNU General
+Public License as published by the Free Software Foundation.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+THE AUTHORS OF THIS LIBRARY ACCEPT ABSOLUTELY NO LIABILITY FOR
+ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE
+TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of
+harming persons must have provisions for completely removing power
+from all motors, etc, before persons enter any danger area.  All
+machinery must be designed to comply with local and national safety
+codes, and the authors of this software can not, and do not, take
+any responsibility for such compliance.
+
+This code was written as part of the LiteX-CNC project.
+
+Copyright (c) 2023 All rights reserved.
+"""
+# Imports for creating a LiteX/Migen module
+from litex.soc.interconnect.csr import *
+from migen import *
+from migen.fhdl.structure import Cat, Constant
+from litex.soc.integration.doc import AutoDoc, ModuleDoc
+
+# Local imports
+from litexcnc_toolerator.config.layout import TooleratorStates
+from litexcnc_toolerator.config.toolerator import TooleratorScopeConfig
+
+
+class TooleratorScope(Module, AutoCSR, AutoDoc):
+
+    def __init__(self, config: 'TooleratorScopeConfig', step_generator, state) -> None:
+
+        self.intro = ModuleDoc("""
+        Capture of the trajectory of the stepgen of a toolerator. When armed, the capture
+        starts when the toolerator starts a move to another tool or starts homing. Every
+        `decimation` clock cycles the speed, position, distance to go and the distance
+        required to stop are stored, until the buffer is full. The buffer is read using
+        the registers of this module, which are not part of the data exchanged with the
+        driver each cycle.
+        """)
+
+        # Rising edge starts waiting for the trigger, a capture in progress is discarded
+        self.arm = Signal()
+        arm_prev = Signal()
+
+        # Registers for reading the capture
+        self._status = CSRStatus(
+            fields=[
+                CSRField("armed", size=1, offset=0, description="Waiting for the start of a move or homing."),
+                CSRField("capturing", size=1, offset=1, description="Capture in progress."),
+                CSRField("done", size=1, offset=2, description="The buffer is full and can be read."),
+                CSRField("level", size=16, offset=16, description="The number of samples stored."),
+            ],
+            description="Status of the capture."
+        )
+        self._config = CSRStatus(
+            fields=[
+                CSRField("depth", size=16, offset=0, description="The number of samples in the buffer.", reset=config.depth),
+                CSRField("decimation", size=16, offset=16, description="The number of clock cycles between samples.", reset=config.decimation),
+            ],
+            description="Settings of the capture."
+        )
+        self._index = CSRStorage(16, description="The index of the sample to be read.")
+        self._speed = CSRStatus(32, description="Speed of the sample (in 2^-32 steps per clock cycle).")
+        self._position = CSRStatus(32, description="Position of the sample (in 1/256 steps).")
+        self._dtg = CSRStatus(32, description="Distance to go of the sample (in 1/256 steps).")
+        self._acc_distance = CSRStatus(32, description="Distance required to stop of the sample (in 1/256 steps).")
+
+        # Buffer, each sample consists of four 32-bit words
+        self.specials.memory = Memory(4 * 32, config.depth)
+        write_port = self.memory.get_port(write_capable=True)
+        read_port = self.memory.get_port()
+        self.specials += write_port, read_port
+
+        # Trigger on the start of a move to another tool or on the start of homing
+        state_prev = Signal(4, reset=TooleratorStates.START)
+        trigger = Signal()
+        self.comb += trigger.eq(
+            (state != state_prev) &
+            ((state == TooleratorStates.MOVING_FORWARD) | (state == TooleratorStates.MOVING_REVERSE)
+             | (state == TooleratorStates.HOME_SEARCHING))
+        )
+
+        # Capture of the samples
+        armed = Signal()
+        capturing = Signal()
+        done = Signal()
+        level = Signal(16)
+        decimation = Signal(16)
+        self.comb += [
+            write_port.adr.eq(level),
+            write_port.dat_w.eq(Cat(
+                step_generator.speed[8:40],
+                step_generator.position[24:56],
+                step_generator.dtg[24:56],
+                step_generator.acc_distance[24:56],
+            )),
+            write_port.we.eq(capturing & (decimation == 0)),
+        ]
+        self.sync += [
+            state_prev.eq(state),
+            arm_prev.eq(self.arm),
+            If(
+                self.arm & ~arm_prev,
+                armed.eq(1),
+                capturing.eq(0),
+                done.eq(0),
+                level.eq(0),
+            ).Elif(
+                armed & trigger,
+                armed.eq(0),
+                capturing.eq(1),
+                decimation.eq(0),
+            ).Elif(
+                capturing,
+                If(
+                    decimation == 0,
+                    decimation.eq(config.decimation - 1),
+                    level.eq(level + 1),
+                    If(
+                        level == config.depth - 1,
+                        capturing.eq(0),
+                        done.eq(1),
+                    )
+                ).Else(
+                    decimation.eq(decimation - 1)
+                )
+            )
+        ]
+
+        # Read-out of the samples
+        self.comb += [
+            self._status.fields.armed.eq(armed),
+            self._status.fields.capturing.eq(capturing),
+            self._status.fields.done.eq(done),
+            self._status.fields.level.eq(level),
+            read_port.adr.eq(self._index.storage),
+            self._speed.status.eq(read_port.dat_r[0:32]),
+            self._position.status.eq(read_port.dat_r[32:64]),
+            self._dtg.status.eq(read_port.dat_r[64:96]),
+            self._acc_distance.status.eq(read_port.dat_r[96:128]),
+        ]
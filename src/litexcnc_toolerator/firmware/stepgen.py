@@ -216,13 +216,6 @@ class StepgenModule(Module, AutoDoc):
         # still waiting for the dir_setup to time out.
         sync += If(
             ~self.reset & ~self.wait,
-            # When the machine is not enabled, the speed is clamped to 0. This results in a
-            # deceleration when the machine is disabled while the machine is running,
-            # preventing possible damage.
-            If(
-                ~self.enable,
-                self.speed_target.eq(0)
-            ),
             If(
                 self.max_acceleration == 0,
                 # Case: no maximum acceleration defined, directly apply the requested speed
@@ -326,6 +319,15 @@ class StepgenModule(Module, AutoDoc):
             )
         )
 
+        # When the machine is not enabled, the speed is clamped to 0. This results in a
+        # deceleration when the machine is disabled while the machine is running,
+        # preventing possible damage. NOTE: this statement must follow the position
+        # algorithm, so it takes precedence over the speed requested by that algorithm.
+        sync += If(
+            ~self.reset & ~self.wait & ~self.enable,
+            self.speed_target.eq(0)
+        )
+
         # Reset algorithm.
         # NOTE: RESETTING the stepgen will not adhere the speed limit and will bring the stepgen
         # to an abrupt standstill
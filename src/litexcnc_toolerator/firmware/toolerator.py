@@ -31,50 +31,111 @@ Copyright (c) 2023 All rights reserved.
 """
 # Imports for creating a json-definition
 from enum import IntEnum, auto
+from functools import reduce
+from operator import xor
 
 # Imports for creating a LiteX/Migen module
 from litex.soc.interconnect.csr import *
 from migen import *
 from migen.fhdl.structure import Cat, Constant
+from migen.genlib.cdc import MultiReg
+from migen.genlib.fifo import SyncFIFO
 from litex.soc.integration.soc import SoC
 from litex.soc.integration.doc import AutoDoc, ModuleDoc
 from litex.build.generic_platform import *
 
 # Local imports
+from litexcnc_toolerator.config.layout import (
+    TooleratorStates, CONFIG_REGISTERS, WRITE_REGISTERS, WRITE_HIGH_REGISTERS, WRITE_EVENT_REGISTERS,
+    READ_REGISTERS, READ_HIGH_REGISTERS, READ_EVENT_REGISTERS, EVENT_REGISTERS, EVENTS_PER_CYCLE,
+    LayoutRegister
+)
 from litexcnc_toolerator.config.toolerator import TooleratorInstanceConfig
 from litexcnc_toolerator.firmware.stepgen import StepgenModule, create_routine
+from litexcnc_toolerator.firmware.scope import TooleratorScope
 
 
-class TooleratorStates(IntEnum):
-    """Different states of the Toolerator. One could use the Migen FSM module, however
-    this statement is rendered as combinatorial. This poses issues with the stepgen, where
-    any change in target_position takes a clock-cycle to be effective. With combinatorial
-    statements parts are skipped when the states are changed.
+class SequencerOps(IntEnum):
+    """Operations of the tool change sequencer. Each instruction is 32 bits wide, with the
+    operation in the upper 4 bits and the argument in the lower 28 bits.
     """
-    START = auto()
-    HOME_SEARCHING = auto()
-    HOME_BACK_OFF = auto()
-    HOME_LATCHING = auto()
-    HOME_MOVE_TO_ZERO = auto()
-    MOVING_FORWARD = auto()
-    MOVING_BACKWARD = auto()
-    READY = auto()
-    ERROR = auto()
+    END = 0
+    SET = auto()
+    CLEAR = auto()
+    WAIT_HIGH = auto()
+    WAIT_LOW = auto()
+    DELAY = auto()
+    MOVE = auto()
+    ROTATE = auto()
 
 
 class TooleratorModule(Module, AutoDoc):
 
     pads_layout = [("step", 1), ("dir", 1), ("home", 1)]
 
+    @staticmethod
+    def compile_program(config: 'TooleratorSequenceConfig', clock_frequency) -> list:
+        """Compiles the program of the sequencer to a list of instructions. The program is
+        terminated with an END instruction.
+        """
+        program = []
+        for line in config.program:
+            op, *args = line.split()
+            op = op.lower()
+            if op in ('move', 'rotate'):
+                if args:
+                    raise ValueError(f"Instruction '{line}' does not take an argument.")
+                program.append(SequencerOps[op.upper()] << 28)
+                continue
+            if len(args) != 1:
+                raise ValueError(f"Instruction '{line}' requires a single argument.")
+            if op in ('set', 'clear'):
+                arg = int(args[0])
+                if not 0 <= arg < len(config.output_pins):
+                    raise ValueError(f"Instruction '{line}' refers to an undefined output.")
+            elif op in ('wait_high', 'wait_low'):
+                arg = int(args[0])
+                if not 0 <= arg < len(config.input_pins):
+                    raise ValueError(f"Instruction '{line}' refers to an undefined input.")
+            elif op == 'delay':
+                arg = int(float(args[0]) * clock_frequency)
+                if not 0 <= arg < (1 << 28):
+                    raise ValueError(f"Instruction '{line}' exceeds the maximum delay.")
+            else:
+                raise ValueError(f"Unknown instruction '{line}'.")
+            program.append((SequencerOps[op.upper()] << 28) | arg)
+        if not any(op >> 28 in (SequencerOps.MOVE, SequencerOps.ROTATE) for op in program):
+            raise ValueError("The program requires a `move` or `rotate` instruction.")
+        program.append(SequencerOps.END << 28)
+        return program
+
     def __init__(self, config: 'TooleratorInstanceConfig',  pick_off, clock_frequency, pads=None) -> None:
 
         # AutoDoc implementation
         self.intro = ModuleDoc(self.__class__.__doc__)
+
+        # The tool numbers and pockets are `tool_width` bits wide. The highest value is
+        # reserved to mark tool IDs which are not in the carousel.
+        if config.tool_count >= (1 << config.tool_width):
+            raise ValueError(f"A tool count of {config.tool_count} requires a wider tool number than {config.tool_width} bits.")
+        if config.carousel and config.carousel.table_size > (1 << config.tool_width):
+            raise ValueError(f"A table size of {config.carousel.table_size} requires a wider tool number than {config.tool_width} bits.")
         
         # Require to test working with Verilog, basically creates extra signals not
         # connected to any pads.
         if pads is None:
-            pads = Record(self.pads_layout)
+            pads_layout = list(self.pads_layout)
+            if config.position_code:
+                pads_layout.append(("code", len(config.position_code.code_pins)))
+            if config.encoder:
+                pads_layout += [("enc_a", 1), ("enc_b", 1)]
+            if config.lock_confirm:
+                pads_layout.append(("lock", 1))
+            if config.sequence and config.sequence.input_pins:
+                pads_layout.append(("seq_in", len(config.sequence.input_pins)))
+            if config.sequence and config.sequence.output_pins:
+                pads_layout.append(("seq_out", len(config.sequence.output_pins)))
+            pads = Record(pads_layout)
         self.pads = pads
 
         # Create a stepgen instance
@@ -97,155 +158,1192 @@ class TooleratorModule(Module, AutoDoc):
         
         # Feed the step generator with information on the tools
         self.enable         = Signal(1)
-        self.current_tool   = Signal(8)
-        self.moving_to_tool = Signal(8)
-        self.commanded_tool = Signal(8)
+        self.current_tool   = Signal(config.tool_width)
+        self.moving_to_tool = Signal(config.tool_width)
+        self.commanded_tool = Signal(config.tool_width)
+        self.move_reverse   = Signal(1)
+        self.tool_change    = Signal(1)
         self.home           = Signal(1)
         self.home_triggered = Signal(1)
         self.home_position  = Signal((64 + (self.step_generator.pick_off_vel - self.step_generator.pick_off_pos), True))
         
-        # Pass the enabled signal to the stepgenerator
-        self.comb += self.step_generator.enable.eq(self.enable)
+        # The state of the finite state machine, see TooleratorStates
+        self.state = Signal(4, reset=TooleratorStates.START)
+
+        # Pass the enabled signal to the stepgenerator. A following error or missed steps
+        # detected at the home switch bring the turret to a soft stop as well.
+        self.following_fault = Signal(1)
+        self.drift_fault     = Signal(1)
+        self.comb += self.step_generator.enable.eq(self.enable & ~self.following_fault & ~self.drift_fault)
+
+        # Distances (in the fixed-point units of the stepgen) between two pockets and
+        # for the over-travel required to lock the ratchet
+        revolution_steps = config.ppr << self.step_generator.pick_off_pos
+        pocket_steps = int((config.ppr << self.step_generator.pick_off_pos) / config.tool_count)
+        over_travel_steps = int((config.ppr << self.step_generator.pick_off_pos) * (config.over_travel / 360))
+
+        def pockets_ahead(from_tool, to_tool):
+            """Returns the number of pockets the turret has to rotate forward to get from
+            `from_tool` to `to_tool`.
+            """
+            return Mux(
+                to_tool >= from_tool,
+                to_tool - from_tool,
+                config.tool_count + to_tool - from_tool
+            )
+
+        def start_move(to_tool):
+            """Returns the statements which start the index move from the current tool
+            to `to_tool`, including the over-travel required to lock the ratchet. A
+            bidirectional carousel moves in the shortest direction.
+            """
+            move_forward = [
+                self.step_generator.position_target.eq(
+                    self.step_generator.position_target
+                        + pocket_steps * pockets_ahead(self.current_tool, to_tool)
+                        + over_travel_steps
+                ),
+                self.move_reverse.eq(0),
+                self.moving_to_tool.eq(to_tool),
+                self.state.eq(TooleratorStates.MOVING_FORWARD)
+            ]
+            if not (config.carousel and config.carousel.bidirectional):
+                return move_forward
+            return [
+                If(
+                    pockets_ahead(self.current_tool, to_tool) <= pockets_ahead(to_tool, self.current_tool),
+                    *move_forward
+                ).Else(
+                    self.step_generator.position_target.eq(
+                        self.step_generator.position_target
+                            - pocket_steps * pockets_ahead(to_tool, self.current_tool)
+                            - over_travel_steps
+                    ),
+                    self.move_reverse.eq(1),
+                    self.moving_to_tool.eq(to_tool),
+                    self.state.eq(TooleratorStates.MOVING_REVERSE)
+                )
+            ]
+
+        def start_trial():
+            """Returns the statements which start a trial revolution during tuning. The
+            turret makes a full revolution plus the over-travel and locks at the same tool.
+            """
+            return [
+                self.step_generator.position_target.eq(
+                    self.step_generator.position_target + revolution_steps + over_travel_steps
+                ),
+                self.tune_back.eq(0),
+                self.tune_crossed.eq(0),
+                self.move_reverse.eq(0),
+                self.moving_to_tool.eq(self.current_tool),
+                self.state.eq(TooleratorStates.TUNING)
+            ]
+
+        # Command FIFO. Each toggle of `queue_push` adds `queue_tool` to the queue. When
+        # the toolerator is READY, queued tools take precedence over the commanded tool,
+        # so a sequence of tool changes is executed back-to-back without waiting for the
+        # host to acknowledge each change. Only a change started for the commanded tool
+        # (`move_from_commanded`) is extended when the commanded tool changes in flight.
+        self.move_from_commanded = Signal(1)
+        self.queue_tool      = Signal(config.tool_width)
+        self.queue_push      = Signal(1)
+        self.queue_push_prev = Signal(1)
+        self.queue_clear     = Signal(1)
+        self.submodules.queue = ResetInserter()(SyncFIFO(width=config.tool_width, depth=config.queue_depth))
+        self.sync += self.queue_push_prev.eq(self.queue_push)
+        self.comb += [
+            self.queue.reset.eq(self.queue_clear),
+            self.queue.din.eq(self.queue_tool),
+            self.queue.we.eq(self.queue_push != self.queue_push_prev),
+        ]
+
+        # The pockets of the commanded tool and the next tool in the queue. In carousel
+        # mode, these are looked up in the tool table, which is stored in block RAM. Each
+        # toggle of `table_write` stores `table_pocket` for the tool `table_tool`. The
+        # result of a lookup is available one clock-cycle after the address has changed,
+        # so a pocket is only valid when the tool has been stable for a clock-cycle. Tool
+        # IDs beyond the table are not in the carousel.
+        self.commanded_pocket = Signal(config.tool_width)
+        self.commanded_valid  = Signal(1)
+        self.queue_pocket     = Signal(config.tool_width)
+        self.queue_valid      = Signal(1)
+        if config.carousel:
+            not_in_carousel = (1 << config.tool_width) - 1
+            self.table_tool       = Signal(config.tool_width)
+            self.table_pocket     = Signal(config.tool_width)
+            self.table_write      = Signal(1)
+            self.table_write_prev = Signal(1)
+            self.specials.table = Memory(
+                config.tool_width, config.carousel.table_size, 
+                init=[tool if tool < config.tool_count else not_in_carousel for tool in range(config.carousel.table_size)]
+            )
+            table_port = self.table.get_port(write_capable=True)
+            queue_port = self.table.get_port()
+            self.specials += table_port, queue_port
+            table_we = Signal(1)
+            table_we_prev = Signal(1)
+            commanded_prev = Signal(config.tool_width)
+            queue_prev = Signal(config.tool_width)
+            self.comb += [
+                table_we.eq((self.table_write != self.table_write_prev) & (self.table_tool < config.carousel.table_size)),
+                table_port.we.eq(table_we),
+                table_port.adr.eq(Mux(table_we, self.table_tool, self.commanded_tool)),
+                table_port.dat_w.eq(self.table_pocket),
+                queue_port.adr.eq(self.queue.dout),
+                self.commanded_pocket.eq(Mux(self.commanded_tool < config.carousel.table_size, table_port.dat_r, not_in_carousel)),
+                self.commanded_valid.eq((self.commanded_tool == commanded_prev) & ~table_we & ~table_we_prev),
+                self.queue_pocket.eq(Mux(self.queue.dout < config.carousel.table_size, queue_port.dat_r, not_in_carousel)),
+                self.queue_valid.eq((self.queue.dout == queue_prev) & ~table_we & ~table_we_prev),
+            ]
+            self.sync += [
+                self.table_write_prev.eq(self.table_write),
+                table_we_prev.eq(table_we),
+                commanded_prev.eq(self.commanded_tool),
+                queue_prev.eq(self.queue.dout),
+            ]
+        else:
+            self.comb += [
+                self.commanded_pocket.eq(self.commanded_tool),
+                self.commanded_valid.eq(1),
+                self.queue_pocket.eq(self.queue.dout),
+                self.queue_valid.eq(1),
+            ]
 
         # Tie in the homing signal
-        if config.homing:
+        if config.homing or config.position_code:
             self.homed = Signal(1)
-            # Connect the pad to the homing triggered
-            if config.homing.invert_home:
-                self.home_triggered.eq(~self.pads.home)
-            else:
-                self.home_triggered.eq(self.pads.home)
         else:
             self.homed = Signal(1, reset=1)
+        if config.homing:
+            # Connect the pad to the homing triggered. The input is synchronized to the
+            # system clock first. Glitches are filtered out by only following the input
+            # when it has been stable for the debounce time.
+            home_sync = Signal(1)
+            self.specials += MultiReg(
+                ~self.pads.home if config.homing.invert_home else self.pads.home,
+                home_sync
+            )
+            debounce_cycles = int(config.homing.home_debounce * 1e-6 * clock_frequency)
+            if debounce_cycles > 0:
+                debounce_counter = Signal(max=debounce_cycles + 1)
+                self.sync += If(
+                    home_sync == self.home_triggered,
+                    debounce_counter.eq(0)
+                ).Elif(
+                    debounce_counter == debounce_cycles - 1,
+                    self.home_triggered.eq(home_sync),
+                    debounce_counter.eq(0)
+                ).Else(
+                    debounce_counter.eq(debounce_counter + 1)
+                )
+            else:
+                self.comb += self.home_triggered.eq(home_sync)
+            # The number of clock-cycles between the edge on the pad and the edge of the
+            # filtered signal (synchronizer and debounce filter)
+            home_delay = debounce_cycles + 2
+
+            # Capture the position on the edges of the home switch in hardware. The
+            # captured position does not depend on the moment the FSM handles the edge,
+            # which allows for homing at full speed.
+            self.home_triggered_prev = Signal(1)
+            self.home_rise           = Signal(1)
+            self.home_fall           = Signal(1)
+            self.home_rise_seen      = Signal(1)
+            self.home_edge_position  = Signal.like(self.step_generator.position)
+            self.home_rise_position  = Signal.like(self.step_generator.position)
+            self.comb += [
+                self.home_rise.eq(self.home_triggered & ~self.home_triggered_prev),
+                self.home_fall.eq(~self.home_triggered & self.home_triggered_prev),
+                # Compensate for the distance travelled during the delay of the filter
+                self.home_edge_position.eq(
+                    self.step_generator.position
+                    - ((self.step_generator.speed * home_delay) >> (self.step_generator.pick_off_acc - self.step_generator.pick_off_vel))
+                ),
+            ]
+            self.sync += [
+                self.home_triggered_prev.eq(self.home_triggered),
+                If(
+                    self.home_rise,
+                    self.home_rise_position.eq(self.home_edge_position)
+                )
+            ]
+            # The reference is either the rising edge of the switch, or the center of the
+            # switch. In the latter case the reference is known at the falling edge, after
+            # the rising edge has been seen during the same approach.
+            if config.homing.home_edge == 'center':
+                home_found = self.home_fall & self.home_rise_seen
+                home_reference = (self.home_rise_position + self.home_edge_position) >> 1
+            else:
+                home_found = self.home_rise
+                home_reference = self.home_edge_position
+
+        # Decode the absolute position of the turret from the coded position inputs.
+        # The inputs are synchronized to the system clock first. The resulting pocket
+        # is only valid when the code lies within the range of codes of the pockets (in
+        # full width, so a code below `first_code` does not wrap around); any other value
+        # indicates the turret is not locked at a pocket. The code is only used when it
+        # has been stable for `code_stable`, so it is not read while the switches change.
+        if config.position_code:
+            code_width = len(config.position_code.code_pins)
+            code = Signal(code_width)
+            self.specials += MultiReg(
+                ~self.pads.code if config.position_code.invert_code else self.pads.code,
+                code
+            )
+            if config.position_code.encoding == 'gray':
+                # Gray to binary: each bit is the XOR of all more significant bits
+                code_binary = Signal(code_width)
+                self.comb += [
+                    code_binary[bit].eq(reduce(xor, [code[j] for j in range(bit, code_width)]))
+                    for bit in range(code_width)
+                ]
+                code = code_binary
+            self.position_code        = Signal(code_width)
+            self.position_code_valid  = Signal(1)
+            self.position_code_stable = Signal(1)
+            first_code = config.position_code.first_code
+            self.comb += [
+                self.position_code.eq(code - first_code),
+                self.position_code_valid.eq((code >= first_code) & (code < first_code + config.tool_count)),
+            ]
+            stable_cycles = max(int(config.position_code.code_stable * 1e-6 * clock_frequency), 1)
+            code_prev = Signal(code_width)
+            code_counter = Signal(max=stable_cycles + 1)
+            self.sync += [
+                code_prev.eq(code),
+                If(
+                    code != code_prev,
+                    code_counter.eq(0),
+                    self.position_code_stable.eq(0)
+                ).Elif(
+                    code_counter == stable_cycles - 1,
+                    self.position_code_stable.eq(1)
+                ).Else(
+                    code_counter.eq(code_counter + 1)
+                )
+            ]
+
+        # Position measured by the quadrature encoder, in the same units as the position of
+        # the stepgen. The inputs are synchronized to the system clock first. The offset
+        # aligns the encoder with the stepgen; it is updated when a following error is
+        # cleared. Without an encoder, the position of the stepgen is reported.
+        self.encoder_position = Signal.like(self.step_generator.position)
+        if config.encoder:
+            encoder = Signal(2)
+            encoder_prev = Signal(2)
+            self.specials += MultiReg(Cat(self.pads.enc_a, self.pads.enc_b), encoder)
+            self.encoder_counts = Signal((32, True))
+            self.encoder_offset = Signal.like(self.step_generator.position)
+            count_up = -1 if config.encoder.reverse else 1
+            self.sync += [
+                encoder_prev.eq(encoder),
+                If(
+                    # Exactly one of the signals changed, A leads B when moving forward
+                    (encoder[0] ^ encoder_prev[0]) ^ (encoder[1] ^ encoder_prev[1]),
+                    If(
+                        encoder[0] ^ encoder_prev[1],
+                        self.encoder_counts.eq(self.encoder_counts + count_up)
+                    ).Else(
+                        self.encoder_counts.eq(self.encoder_counts - count_up)
+                    )
+                )
+            ]
+            encoder_scale = int((config.ppr << self.step_generator.pick_off_pos) / config.encoder.cpr)
+            self.comb += self.encoder_position.eq(self.encoder_counts * encoder_scale + self.encoder_offset)
+        else:
+            self.comb += self.encoder_position.eq(self.step_generator.position)
+
+        # Sequencer, which runs the program for each tool change. The program is stored in
+        # block RAM; the instruction at `seq_pc` is available one clock-cycle after the
+        # program counter has changed, which is indicated by `seq_fetched`.
+        self.seq_active = Signal(1)
+        if config.sequence:
+            program = self.compile_program(config.sequence, clock_frequency)
+            self.specials.seq_memory = Memory(32, len(program), init=program)
+            seq_port = self.seq_memory.get_port()
+            self.specials += seq_port
+            self.seq_pc      = Signal(max=len(program))
+            self.seq_fetched = Signal(1)
+            self.seq_timer   = Signal(28)
+            self.seq_homing  = Signal(1)
+            self.seq_op      = Signal(4)
+            self.seq_arg     = Signal(28)
+            self.comb += [
+                seq_port.adr.eq(self.seq_pc),
+                self.seq_op.eq(seq_port.dat_r[28:32]),
+                self.seq_arg.eq(seq_port.dat_r[0:28]),
+            ]
+            self.seq_outputs = Signal(max(len(config.sequence.output_pins), 1))
+            if config.sequence.output_pins:
+                self.comb += self.pads.seq_out.eq(self.seq_outputs)
+            self.seq_inputs = Signal(max(len(config.sequence.input_pins), 1))
+            if config.sequence.input_pins:
+                self.specials += MultiReg(
+                    ~self.pads.seq_in if config.sequence.invert_inputs else self.pads.seq_in,
+                    self.seq_inputs
+                )
+            seq_output = Array(self.seq_outputs[bit] for bit in range(len(self.seq_outputs)))
+            seq_input = Array(self.seq_inputs[bit] for bit in range(len(self.seq_inputs)))
+            seq_timeout_cycles = int(config.sequence.wait_timeout * clock_frequency)
+
+        def start_change(to_tool):
+            """Returns the statements which start a tool change to `to_tool`. With a
+            sequencer, the program is started, which in turn starts the index move.
+            """
+            if not config.sequence:
+                return start_move(to_tool)
+            return [
+                self.moving_to_tool.eq(to_tool),
+                self.seq_homing.eq(0),
+                self.seq_pc.eq(0),
+                self.seq_fetched.eq(0),
+                self.seq_timer.eq(0),
+                self.seq_active.eq(1),
+                self.state.eq(TooleratorStates.SEQUENCING)
+            ]
+
+        # Tuning is requested on the rising edge of `tune`. The turret makes a number of trial
+        # revolutions with increasing speed and acceleration, until steps are missed. The
+        # number of trials passed and the corresponding speed and acceleration are reported.
+        self.tune           = Signal(1)
+        self.tune_prev      = Signal(1)
+        self.tune_requested = Signal(1)
+        self.tune_level     = Signal(5)
+        self.tune_back      = Signal(1)
+        self.tune_crossed   = Signal(1)
+        self.tune_passed    = Signal(6)
+        self.tune_max_vel   = Signal(32)
+        self.tune_max_acc   = Signal(32)
+        if config.tuning:
+            if not (config.homing or config.encoder):
+                raise ValueError("Tuning requires a home switch or an encoder to detect missed steps.")
+            if config.sequence:
+                # The trial revolutions would rotate the turret without running the program
+                raise ValueError("Tuning is not supported in combination with a sequence program.")
+            self.sync += [
+                self.tune_prev.eq(self.tune),
+                If(
+                    self.tune & ~self.tune_prev,
+                    self.tune_requested.eq(1)
+                )
+            ]
+            # The speed and acceleration of each trial, the first entry is reported when no
+            # trial has passed
+            levels = config.tuning.levels
+            factors = [
+                config.tuning.start + (1 - config.tuning.start) * level / (levels - 1) 
+                for level in range(levels)
+            ] if levels > 1 else [1.0]
+            trial_speed = Array(
+                Constant(int((config.tuning.max_vel * factor * (1 << 40)) / clock_frequency), self.step_generator.max_speed.nbits)
+                for factor in factors
+            )
+            trial_acceleration = Array(
+                Constant(int((config.tuning.max_acc * factor * (1 << 48)) / clock_frequency**2), 32)
+                for factor in factors
+            )
+            self.comb += [
+                # The trial profile is used for the revolution, the lock move uses the normal profile
+                If(
+                    (self.state == TooleratorStates.TUNING) & ~self.tune_back,
+                    self.step_generator.max_speed.eq(trial_speed[self.tune_level]),
+                    self.step_generator.max_acceleration.eq(trial_acceleration[self.tune_level])
+                ),
+                self.tune_max_vel.eq(Array([0] + [int(round(config.tuning.max_vel * factor)) for factor in factors])[self.tune_passed]),
+                self.tune_max_acc.eq(Array([0] + [int(round(config.tuning.max_acc * factor)) for factor in factors])[self.tune_passed]),
+            ]
+
+        # Homing is requested on the rising edge of `home`. The request is kept until it
+        # has been handled by the FSM.
+        self.home_prev      = Signal(1)
+        self.home_requested = Signal(1)
+        self.sync += [
+            self.home_prev.eq(self.home),
+            If(
+                self.home & ~self.home_prev,
+                self.home_requested.eq(1)
+            )
+        ]
+
+        # The driver restores the pocket the turret was locked at in the previous run. The
+        # restore is requested on the rising edge of `restore_valid` and is applied when the
+        # position of the turret is not known yet. The restored pocket is optionally
+        # verified by a single pass over the home switch.
+        self.restore_tool      = Signal(config.tool_width)
+        self.restore_valid     = Signal(1)
+        self.restore_prev      = Signal(1)
+        self.restore_requested = Signal(1)
+        self.restored_tool     = Signal(config.tool_width)
+        self.restored_position = Signal.like(self.step_generator.position)
+        self.verify_pending    = Signal(1)
+        self.sync += [
+            self.restore_prev.eq(self.restore_valid),
+            If(
+                self.restore_valid & ~self.restore_prev,
+                self.restore_requested.eq(1)
+            )
+        ]
+
+        # The move back into the ratchet uses a separate (gentle) profile, when defined. The
+        # profile is only switched when the turret has stopped.
+        if config.stepgen.lock_speed:
+            lock_speed = config.stepgen.lock_speed
+            self.comb += If(
+                (self.state == TooleratorStates.MOVING_BACKWARD) 
+                | ((self.state == TooleratorStates.TUNING) & self.tune_back),
+                self.step_generator.max_acceleration.eq(int((lock_speed.max_acc * (1 << 48)) / clock_frequency**2)),
+                self.step_generator.max_speed.eq(int((lock_speed.max_vel * (1 << 40)) / clock_frequency)),
+            )
+
+        # The move back into the ratchet finishes when the turret has stopped. With a lock
+        # confirmation sensor, the move is ended as soon as the lock has been confirmed: on
+        # the rising edge of the sensor the stepgen decelerates to a standstill (in velocity
+        # mode, so it does not return to the point of confirmation) with the lock profile,
+        # after which the target is set to the position reached. When the lock is not
+        # confirmed in time, the toolerator enters the ERROR state.
+        lock_done = [
+            self.current_tool.eq(self.moving_to_tool),
+            self.state.eq(TooleratorStates.READY)
+        ]
+        if config.sequence:
+            # The move has been started by the program, continue with the next instruction
+            lock_done.append(
+                If(
+                    self.seq_active,
+                    self.seq_pc.eq(self.seq_pc + 1),
+                    self.seq_fetched.eq(0),
+                    self.seq_timer.eq(0),
+                    self.state.eq(TooleratorStates.SEQUENCING)
+                )
+            )
+        lock_move = If(
+            self.step_generator.stopped,
+            *lock_done
+        )
+        if config.lock_confirm:
+            self.locked = Signal(1)
+            self.specials += MultiReg(
+                ~self.pads.lock if config.lock_confirm.invert_lock else self.pads.lock,
+                self.locked
+            )
+            self.locked_prev    = Signal(1)
+            self.lock_confirmed = Signal(1)
+            lock_timeout_cycles = int(config.lock_confirm.lock_timeout * clock_frequency)
+            lock_timer = Signal(max=lock_timeout_cycles + 1)
+            self.sync += [
+                self.locked_prev.eq(self.locked),
+                If(
+                    self.state != TooleratorStates.MOVING_BACKWARD,
+                    lock_timer.eq(0),
+                    self.lock_confirmed.eq(0)
+                ).Elif(
+                    lock_timer != lock_timeout_cycles,
+                    lock_timer.eq(lock_timer + 1)
+                )
+            ]
+            lock_move = If(
+                self.lock_confirmed,
+                If(
+                    # The turret has come to a standstill after the confirmation
+                    self.step_generator.speed == 0,
+                    self.step_generator.position_target.eq(self.step_generator.position),
+                    self.step_generator.position_mode.eq(1),
+                    self.lock_confirmed.eq(0),
+                    *lock_done
+                )
+            ).Elif(
+                self.locked & ~self.locked_prev,
+                self.step_generator.position_mode.eq(0),
+                self.step_generator.speed_target.eq(0),
+                self.lock_confirmed.eq(1)
+            ).Elif(
+                lock_timer == lock_timeout_cycles,
+                self.step_generator.position_target.eq(self.step_generator.position),
+                self.state.eq(TooleratorStates.ERROR)
+            )
 
         # Create a finite state machine
-        self.state = Signal(4, reset=TooleratorStates.START)
-        self.sync += If(
-            self.state == TooleratorStates.START,
+        self.comb += self.queue.re.eq(
+            (self.state == TooleratorStates.READY) & self.homed & self.enable & ~self.home_requested 
+            & ~self.tune_requested & self.queue.readable & self.queue_valid
+        )
+        start = [
             If(
                 self.homed == 1,
                 self.step_generator.position_mode.eq(1),
                 self.state.eq(TooleratorStates.READY)
-            ),
-            If(
-                self.home == 1 | ((self.current_tool != self.commanded_tool) & ~self.homed),
-                # Start homing sequence, start turning the tool changer at full speed
+            )
+        ]
+        if not (config.homing or config.position_code):
+            start.append(
+                If(
+                    # Without any means to determine the position, the turret is homed in
+                    # place with the current tool assumed to be the first tool
+                    self.home_requested,
+                    self.current_tool.eq(0),
+                    self.homed.eq(1),
+                    self.home_requested.eq(0)
+                )
+            )
+        if config.position_code:
+            start.append(
+                If(
+                    # The turret reports its absolute position, so no homing is required. A
+                    # request for homing is handled by the home switch when available.
+                    self.enable & ~self.homed & (~self.home_requested if config.homing else 1) 
+                    & self.position_code_stable,
+                    If(
+                        self.position_code_valid,
+                        self.current_tool.eq(self.position_code),
+                        self.homed.eq(1),
+                        self.home_requested.eq(0)
+                    ).Else(
+                        # The turret is not locked at a pocket or the switches are faulty.
+                        # With a home switch, a tool change homes the turret instead (see
+                        # below).
+                        self.state.eq(TooleratorStates.ERROR)
+                    )
+                )
+            )
+        # The coded position switches take precedence over a restored position. The
+        # restore is applied once the toolerator is enabled, because the reference is
+        # discarded while it is disabled (unless kept, see `keep_reference_on_disable`).
+        # Without any means to determine the position, the turret is already READY and
+        # the restore is applied there.
+        not_referenced = ~self.homed
+        if config.homing and not config.position_code:
+            not_referenced = ~self.homed & ~self.restore_requested
+            if config.homing.verify_restore:
+                start.append(
+                    If(
+                        # Store the restored pocket and its position and confirm it by homing
+                        self.enable & self.restore_requested & ~self.homed,
+                        self.restored_tool.eq(self.restore_tool),
+                        self.restored_position.eq(self.step_generator.position),
+                        self.verify_pending.eq(1),
+                        self.restore_requested.eq(0),
+                        self.home_requested.eq(1)
+                    )
+                )
+            else:
+                start.append(
+                    If(
+                        self.enable & self.restore_requested & ~self.homed,
+                        self.current_tool.eq(self.restore_tool),
+                        self.moving_to_tool.eq(self.restore_tool),
+                        self.homed.eq(1),
+                        self.restore_requested.eq(0)
+                    )
+                )
+        ready = []
+        if not (config.homing or config.position_code):
+            ready.append(
+                If(
+                    self.restore_requested,
+                    self.current_tool.eq(self.restore_tool),
+                    self.moving_to_tool.eq(self.restore_tool),
+                    self.restore_requested.eq(0)
+                )
+            )
+        search_home = []
+        if config.homing:
+            # Start the search for the home switch, turning the tool changer at full speed
+            search_home = [
+                self.home_rise_seen.eq(0),
                 self.step_generator.position_mode.eq(0),
                 self.home_position.eq(self.step_generator.position),
                 self.step_generator.speed_target.eq(self.step_generator.max_speed),
                 self.state.eq(TooleratorStates.HOME_SEARCHING)
+            ]
+            if config.sequence:
+                # The turret is homed by the program as well (for example to unclamp it
+                # first), the search replaces the first index move of the program. The
+                # program continues after the turret has been locked at the first tool.
+                start_homing = [*start_change(0), self.seq_homing.eq(1)]
+            else:
+                start_homing = search_home
+            start.append(
+                If(
+                    self.enable & (
+                        self.home_requested 
+                        | (self.tool_change & not_referenced)
+                        | (not_referenced if config.homing.home_on_enable else 0)
+                    ),
+                    # Start homing sequence
+                    self.homed.eq(0),
+                    self.move_from_commanded.eq(0),
+                    self.home_requested.eq(0),
+                    *start_homing
+                )
             )
+        self.sync += If(
+            self.state == TooleratorStates.START,
+            *start
         ).Elif(
-            self.state == TooleratorStates.MOVING_FORWARD,
+            (self.state == TooleratorStates.MOVING_FORWARD) | (self.state == TooleratorStates.MOVING_REVERSE),
             If(
                 self.step_generator.stopped,
-                self.step_generator.position_target.eq(
-                    self.step_generator.position_target 
-                        - int((config.ppr << self.step_generator.pick_off_pos) * (config.over_travel / 360))
+                # Move back over the over-travel, opposite to the direction of the move
+                If(
+                    self.move_reverse,
+                    self.step_generator.position_target.eq(
+                        self.step_generator.position_target + over_travel_steps
+                    )
+                ).Else(
+                    self.step_generator.position_target.eq(
+                        self.step_generator.position_target - over_travel_steps
+                    )
                 ),
                 self.state.eq(TooleratorStates.MOVING_BACKWARD)
+            ).Elif(
+                # The commanded tool has been changed during the move and lies further
+                # ahead than the tool we are moving to. Extend the move, so the turret
+                # continues to the new tool without locking in between. A tool which lies
+                # behind the target is handled after the current change has finished. A
+                # move to a queued tool is never extended, so the queued tool is not skipped.
+                self.move_from_commanded & self.tool_change & self.homed & ~self.move_reverse 
+                & self.commanded_valid & (self.commanded_pocket < config.tool_count)
+                & (pockets_ahead(self.current_tool, self.commanded_pocket) > pockets_ahead(self.current_tool, self.moving_to_tool)),
+                self.step_generator.position_target.eq(
+                    self.step_generator.position_target
+                        + pocket_steps * pockets_ahead(self.moving_to_tool, self.commanded_pocket)
+                ),
+                self.moving_to_tool.eq(self.commanded_pocket)
             )
         ).Elif(
             self.state == TooleratorStates.MOVING_BACKWARD,
-            If(
-                self.step_generator.stopped,
-                self.current_tool.eq(self.moving_to_tool),
-                self.state.eq(TooleratorStates.READY)
-            )
+            lock_move
         ).Elif(
             self.state == TooleratorStates.READY,
+            *ready,
+            self.move_from_commanded.eq(0),
             If(
-                (self.current_tool != self.commanded_tool) & self.homed,
+                # Homing has been requested, the position of the turret is determined again
+                # from the START state
+                self.home_requested,
+                self.homed.eq(0),
+                self.state.eq(TooleratorStates.START)
+            ).Elif(
+                # Start tuning with the first trial
+                self.enable & self.tune_requested & self.homed,
+                self.tune_requested.eq(0),
+                self.tune_level.eq(0),
+                self.tune_passed.eq(0),
+                *start_trial()
+            ).Elif(
+                self.queue.re,
+                # Next tool from the queue. When the turret is already at this tool, the
+                # entry is simply discarded.
                 If(
-                    self.current_tool < self.commanded_tool,
-                    self.step_generator.position_target.eq(
-                        self.step_generator.position_target 
-                            + int((config.ppr << self.step_generator.pick_off_pos) / config.tool_count) * (self.commanded_tool - self.current_tool)
-                            + int((config.ppr << self.step_generator.pick_off_pos) * (config.over_travel / 360)
-                        ) 
-                    ),
+                    self.queue_pocket >= config.tool_count,
+                    # The tool is not in the carousel
+                    self.state.eq(TooleratorStates.ERROR)
+                ).Elif(
+                    self.current_tool != self.queue_pocket,
+                    *start_change(self.queue_pocket)
+                )
+            ).Elif(
+                self.enable & self.tool_change & self.commanded_valid 
+                & (self.current_tool != self.commanded_pocket) & self.homed,
+                If(
+                    self.commanded_pocket >= config.tool_count,
+                    # The tool is not in the carousel
+                    self.state.eq(TooleratorStates.ERROR)
                 ).Else(
-                    self.step_generator.position_target.eq(
-                        self.step_generator.position_target 
-                            + int((config.ppr << self.step_generator.pick_off_pos) / config.tool_count) * (config.tool_count + self.commanded_tool - self.current_tool)
-                            + int((config.ppr << self.step_generator.pick_off_pos) * (config.over_travel / 360)
-                        )
-                    ),
-                ),
-                self.moving_to_tool.eq(self.commanded_tool),
-                self.state.eq(TooleratorStates.MOVING_FORWARD)
+                    self.move_from_commanded.eq(1),
+                    *start_change(self.commanded_pocket)
+                )
             )
         )
         if config.homing:
-            self.sync += If(
+            back_off_steps = int(revolution_steps * ((config.homing.home_back_off or config.over_travel) / 360))
+            home_offset_steps = int(revolution_steps * ((config.homing.home_position or 0) / 360))
+            # Without a latch velocity, the reference captured at full speed is used directly
+            # (single-pass homing). Otherwise the turret backs off and approaches the switch
+            # once more at the latch velocity.
+            if config.homing.home_latch_vel is None:
+                state_after_search = TooleratorStates.HOME_MOVE_TO_ZERO
+            else:
+                state_after_search = TooleratorStates.HOME_BACK_OFF
+                latch_speed = int((config.homing.home_latch_vel * (1 << 40)) / clock_frequency)
+            # Move to the first tool. When the position of the first tool is positive, the
+            # turret moves forward including the over-travel and locks afterwards. When the
+            # turret overshot the first tool while stopping, an additional revolution is
+            # made. When the position is negative, the turret moves back to its locking
+            # position directly.
+            if home_offset_steps >= 0:
+                zero_target = self.home_position + home_offset_steps + over_travel_steps
+                move_to_zero = [
+                    If(
+                        zero_target > self.step_generator.position,
+                        self.step_generator.position_target.eq(zero_target)
+                    ).Else(
+                        self.step_generator.position_target.eq(zero_target + revolution_steps)
+                    ),
+                    self.state.eq(TooleratorStates.MOVING_FORWARD)
+                ]
+            else:
+                move_to_zero = [
+                    self.step_generator.position_target.eq(self.home_position + home_offset_steps),
+                    self.state.eq(TooleratorStates.MOVING_BACKWARD)
+                ]
+            # Verification of a restored pocket. The home switch is expected at the first
+            # crossing ahead of the position where the pocket was restored. When the found
+            # reference differs more than half a pocket, the restored pocket was wrong.
+            verify = [self.verify_pending.eq(0)]
+            if config.homing.verify_restore:
+                expected_first = (
+                    self.restored_position 
+                    + pocket_steps * pockets_ahead(self.restored_tool, 0) 
+                    - home_offset_steps
+                )
+                home_expected = Signal.like(self.home_position)
+                self.comb += If(
+                    expected_first > self.restored_position,
+                    home_expected.eq(expected_first)
+                ).Else(
+                    home_expected.eq(expected_first + revolution_steps)
+                )
+                verify.append(
+                    If(
+                        self.verify_pending & (
+                            (home_reference - home_expected > (pocket_steps >> 1))
+                            | (home_expected - home_reference > (pocket_steps >> 1))
+                        ),
+                        self.state.eq(TooleratorStates.ERROR)
+                    )
+                )
+            homing = If(
                 self.state == TooleratorStates.HOME_SEARCHING,
+                If(self.home_rise, self.home_rise_seen.eq(1)),
                 If(
-                    # Home has been triggered, stop the movement
-                    self.home_triggered,
-                    self.home_position.eq(self.step_generator.position),
+                    # Home has been found, stop the movement
+                    home_found,
+                    self.home_position.eq(home_reference),
                     self.step_generator.speed_target.eq(0),
-                    self.state.eq(TooleratorStates.HOME_BACK_OFF)
-                ),
-                If(
+                    self.state.eq(state_after_search),
+                    *verify
+                ).Elif(
                     # After a full revolution the home switch has not been found
-                    self.home_position - self.step_generator.position > (config.ppr + 1),
+                    self.step_generator.position - self.home_position > revolution_steps + pocket_steps,
                     self.step_generator.speed_target.eq(0),
+                    self.verify_pending.eq(0),
                     self.state.eq(TooleratorStates.ERROR)
                 )
-            ).Elif(
-                self.state == TooleratorStates.HOME_BACK_OFF,
-                # Wait until the stepper motor has been stopped
+            )
+            if config.homing.home_latch_vel is not None:
+                homing.Elif(
+                    self.state == TooleratorStates.HOME_BACK_OFF,
+                    If(
+                        # Wait until the stepper motor has been stopped and move back
+                        ~self.step_generator.position_mode & (self.step_generator.speed == 0),
+                        self.step_generator.position_mode.eq(1),
+                        self.step_generator.position_target.eq(self.home_position - back_off_steps)
+                    ).Elif(
+                        # Wait until the back off distance has been reached. Switch back to
+                        # velocity mode and approach the homing switch once more
+                        self.step_generator.position_mode & self.step_generator.stopped,
+                        self.step_generator.position_mode.eq(0),
+                        self.home_position.eq(self.step_generator.position),
+                        self.home_rise_seen.eq(0),
+                        self.step_generator.speed_target.eq(latch_speed),
+                        self.state.eq(TooleratorStates.HOME_LATCHING)
+                    )
+                ).Elif(
+                    self.state == TooleratorStates.HOME_LATCHING,
+                    If(self.home_rise, self.home_rise_seen.eq(1)),
+                    If(
+                        # Home has been found, stop the movement
+                        home_found,
+                        self.home_position.eq(home_reference),
+                        self.step_generator.speed_target.eq(0),
+                        self.state.eq(TooleratorStates.HOME_MOVE_TO_ZERO)
+                    ).Elif(
+                        # The home switch has not been found within two back off distances (plus
+                        # a pocket to allow for the width of the switch)
+                        (self.step_generator.position - self.home_position > 2 * back_off_steps + pocket_steps)
+                        | (self.home_position - self.step_generator.position > 2 * back_off_steps + pocket_steps),
+                        self.step_generator.speed_target.eq(0),
+                        self.state.eq(TooleratorStates.ERROR)
+                    )
+                )
+            homing.Elif(
+                self.state == TooleratorStates.HOME_MOVE_TO_ZERO,
                 If(
-                    self.step_generator.position_mode == 0 & self.step_generator.stopped,
+                    # Wait until the stepper motor has been stopped, the reference has
+                    # been established at this point
+                    self.step_generator.speed == 0,
                     self.step_generator.position_mode.eq(1),
-                    self.step_generator.position_target.eq(
-                        self.home_position
-                            - int((config.ppr << self.step_generator.pick_off_pos) * (((config.homing.home_back_off or config.over_travel) / 360)))
-                    )
+                    *move_to_zero,
+                    self.move_reverse.eq(0),
+                    self.current_tool.eq(0),
+                    self.moving_to_tool.eq(0),
+                    self.homed.eq(1)
+                )
+            )
+            self.sync += homing
+
+            # Each time the turret passes the home switch during a tool change, the position
+            # of the switch is compared with the reference. The nearest position of the switch
+            # is tracked while the turret rotates. When the reference has not been found by
+            # homing (coded or restored position), the first pass establishes the reference.
+            self.home_expected  = Signal.like(self.home_position)
+            self.home_drift     = Signal.like(self.home_position)
+            self.drift_valid    = Signal(1)
+            self.sync += [
+                If(
+                    ~self.homed,
+                    self.home_expected.eq(self.home_position),
+                    self.home_drift.eq(0),
+                    self.drift_valid.eq(0)
+                ).Elif(
+                    self.step_generator.position - self.home_expected > (revolution_steps >> 1),
+                    self.home_expected.eq(self.home_expected + revolution_steps)
+                ).Elif(
+                    self.home_expected - self.step_generator.position > (revolution_steps >> 1),
+                    self.home_expected.eq(self.home_expected - revolution_steps)
+                ),
+                If(
+                    self.state == TooleratorStates.HOME_MOVE_TO_ZERO,
+                    self.drift_valid.eq(1)
                 ),
-                # Wait until the stepper motor has stopped again. This time the back off distance has been reached
                 If(
-                    self.step_generator.position_mode == 1 & self.step_generator.stopped,
-                    # Switch back to velocity mode and approach the homing switch once more
-                    self.home_position.eq(self.step_generator.position),
-                    self.step_generator.speed_target.eq(int((config.homing.home_latch_vel << self.step_generator.pick_off_vel) / clock_frequency)),
-                    self.state.eq(TooleratorStates.HOME_LATCHING)
+                    (self.state == TooleratorStates.MOVING_FORWARD) | (self.state == TooleratorStates.MOVING_REVERSE)
+                    | (self.state == TooleratorStates.TUNING),
+                    If(self.home_rise, self.home_rise_seen.eq(1))
+                ).Elif(
+                    self.state == TooleratorStates.MOVING_BACKWARD,
+                    self.home_rise_seen.eq(0)
                 )
-            ).Elif(
-                self.state == TooleratorStates.HOME_LATCHING,
+            ]
+            drift = home_reference - self.home_expected
+            drift_check = [
                 If(
-                    # Home has been triggered, stop the movement
-                    self.home_triggered,
-                    self.home_position.eq(self.step_generator.position),
-                    self.step_generator.speed_target.eq(0),
-                    self.state.eq(TooleratorStates.HOME_BACK_OFF)
+                    self.drift_valid,
+                    self.home_drift.eq(drift)
+                ).Else(
+                    self.home_expected.eq(home_reference),
+                    self.drift_valid.eq(1)
+                )
+            ]
+            if config.homing.max_drift is not None:
+                # Steps have been missed, stop the turret at its current position. The fault
+                # is cleared when the toolerator is disabled.
+                max_drift = int(revolution_steps * (config.homing.max_drift / 360))
+                drift_check.append(
+                    If(
+                        self.drift_valid & ((drift > max_drift) | (drift < -max_drift)),
+                        self.drift_fault.eq(1),
+                        self.homed.eq(0),
+                        self.step_generator.position_target.eq(self.step_generator.position),
+                        self.state.eq(TooleratorStates.ERROR)
+                    )
+                )
+                self.sync += If(
+                    ~self.enable & (self.step_generator.speed == 0),
+                    self.drift_fault.eq(0)
+                )
+            self.sync += If(
+                self.homed & home_found & ~self.move_reverse
+                & ((self.state == TooleratorStates.MOVING_FORWARD) | (self.state == TooleratorStates.TUNING)),
+                *drift_check
+            )
+        # Tuning. After each trial revolution the turret locks at the same tool again. A
+        # trial has passed when the home switch has been found at the reference (and no
+        # following error occurred). When steps have been missed, the turret has lost its
+        # reference and the toolerator enters the ERROR state; the result of the last
+        # passed trial is kept.
+        if config.tuning:
+            trial_end = [
+                self.step_generator.position_target.eq(
+                    self.step_generator.position_target - over_travel_steps
                 ),
+                self.tune_back.eq(1)
+            ]
+            trial_forward = []
+            if config.homing:
+                max_trial_drift = int(revolution_steps * (config.tuning.max_drift / 360))
+                trial_forward.append(If(home_found, self.tune_crossed.eq(1)))
+                trial_end = [
+                    If(
+                        ~self.tune_crossed 
+                        | (self.home_drift > max_trial_drift) | (self.home_drift < -max_trial_drift),
+                        self.homed.eq(0),
+                        self.state.eq(TooleratorStates.ERROR)
+                    ).Else(
+                        *trial_end
+                    )
+                ]
+            self.sync += If(
+                self.state == TooleratorStates.TUNING,
                 If(
-                    # The home switch has not been found within two back off distances
-                    self.home_position - self.step_generator.position > int((config.ppr << self.step_generator.pick_off_pos) * (((config.homing.home_back_off or config.over_travel) / 360))),
-                    self.step_generator.speed_target.eq(0),
-                    self.state.eq(TooleratorStates.ERROR)
+                    ~self.tune_back,
+                    *trial_forward,
+                    If(
+                        self.step_generator.stopped,
+                        *trial_end
+                    )
+                ).Elif(
+                    self.step_generator.stopped,
+                    self.tune_passed.eq(self.tune_level + 1),
+                    If(
+                        self.tune_level == config.tuning.levels - 1,
+                        self.state.eq(TooleratorStates.READY)
+                    ).Else(
+                        self.tune_level.eq(self.tune_level + 1),
+                        *start_trial()
+                    )
                 )
-            ).Elif(
-                self.state == TooleratorStates.HOME_MOVE_TO_ZERO,
-                # Wait until the stepper motor has been stopped
+            )
+
+        # Execution of the program by the sequencer. Each instruction is executed after it
+        # has been fetched from the block RAM. The index moves are executed by the states
+        # MOVING_FORWARD (or MOVING_REVERSE) and MOVING_BACKWARD (`move`), or within this
+        # state (`rotate`). When homing, the first index move is replaced by the homing
+        # sequence. The program is active from its first fetch on and is aborted when the
+        # toolerator enters the ERROR state or is disabled.
+        if config.sequence:
+            next_instruction = [
+                self.seq_pc.eq(self.seq_pc + 1),
+                self.seq_fetched.eq(0),
+                self.seq_timer.eq(0)
+            ]
+            self.sync += If(
+                self.state == TooleratorStates.SEQUENCING,
                 If(
-                    self.step_generator.position_mode.eq(0) & self.step_generator.stopped,
-                    self.step_generator.position_mode.eq(1),
-                    self.step_generator.position_target.eq(
-                        self.home_position
-                            - int((config.ppr << self.step_generator.pick_off_pos) * ((config.homing.home_position / 360)))
-                            + int((config.ppr << self.step_generator.pick_off_pos) * ((config.over_travel / 360)))
+                    ~self.seq_fetched,
+                    self.seq_fetched.eq(1),
+                    self.seq_active.eq(1)
+                ).Elif(
+                    self.seq_op == SequencerOps.END,
+                    self.current_tool.eq(self.moving_to_tool),
+                    self.seq_active.eq(0),
+                    self.state.eq(TooleratorStates.READY)
+                ).Elif(
+                    self.seq_op == SequencerOps.SET,
+                    seq_output[self.seq_arg[0:3]].eq(1),
+                    *next_instruction
+                ).Elif(
+                    self.seq_op == SequencerOps.CLEAR,
+                    seq_output[self.seq_arg[0:3]].eq(0),
+                    *next_instruction
+                ).Elif(
+                    (self.seq_op == SequencerOps.WAIT_HIGH) | (self.seq_op == SequencerOps.WAIT_LOW),
+                    If(
+                        seq_input[self.seq_arg[0:3]] == (self.seq_op == SequencerOps.WAIT_HIGH),
+                        *next_instruction
+                    ).Elif(
+                        self.seq_timer == seq_timeout_cycles,
+                        self.seq_active.eq(0),
+                        self.state.eq(TooleratorStates.ERROR)
+                    ).Else(
+                        self.seq_timer.eq(self.seq_timer + 1)
+                    )
+                ).Elif(
+                    self.seq_op == SequencerOps.DELAY,
+                    If(
+                        self.seq_timer >= self.seq_arg,
+                        *next_instruction
+                    ).Else(
+                        self.seq_timer.eq(self.seq_timer + 1)
                     )
+                ).Elif(
+                    self.seq_op == SequencerOps.MOVE,
+                    If(
+                        self.seq_homing,
+                        self.seq_homing.eq(0),
+                        *search_home
+                    ).Elif(
+                        self.current_tool != self.moving_to_tool,
+                        *start_move(self.moving_to_tool)
+                    ).Else(
+                        *next_instruction
+                    )
+                ).Elif(
+                    self.seq_op == SequencerOps.ROTATE,
+                    If(
+                        self.seq_homing,
+                        self.seq_homing.eq(0),
+                        *search_home
+                    ).Elif(
+                        # The timer indicates the move has been started
+                        self.seq_timer == 0,
+                        self.step_generator.position_target.eq(
+                            self.step_generator.position_target
+                                + pocket_steps * pockets_ahead(self.current_tool, self.moving_to_tool)
+                        ),
+                        self.seq_timer.eq(1)
+                    ).Elif(
+                        self.step_generator.stopped,
+                        self.current_tool.eq(self.moving_to_tool),
+                        *next_instruction
+                    )
+                )
+            ).Elif(
+                (self.state == TooleratorStates.ERROR) | (self.state == TooleratorStates.START),
+                self.seq_active.eq(0)
+            )
+
+        # The turret is stopped as soon as the difference between the stepgen and the encoder
+        # exceeds the maximum following error: the stepgen is disabled and its target is
+        # set to its current position. The reference is lost, because steps have
+        # been missed. The fault is cleared when the toolerator is disabled, after which
+        # the encoder is aligned with the stepgen again.
+        if config.encoder:
+            following_error = self.step_generator.position - self.encoder_position
+            max_following_error = int((config.ppr << self.step_generator.pick_off_pos) * (config.encoder.max_following_error / 360))
+            self.sync += If(
+                self.enable & ~self.following_fault 
+                & ((following_error > max_following_error) | (following_error < -max_following_error)),
+                self.following_fault.eq(1),
+                self.homed.eq(0),
+                self.step_generator.position_target.eq(self.step_generator.position),
+                self.state.eq(TooleratorStates.ERROR)
+            ).Elif(
+                ~self.enable & (self.step_generator.speed == 0) & self.following_fault,
+                self.following_fault.eq(0),
+                self.encoder_offset.eq(self.step_generator.position - self.encoder_counts * encoder_scale)
+            )
+
+        # Disabling the toolerator brings the turret to a soft stop: the stepgen clamps its
+        # speed to 0 within the acceleration limits, also when the target has not been
+        # reached. When the turret is locked at a pocket at that moment, the reference is
+        # kept (when configured). In all other cases the reference is lost as soon as the
+        # turret has stopped and the position has to be determined again; the target is
+        # then set to the position the turret stopped at, so the interrupted move is not
+        # resumed when the toolerator is enabled again. Disabling the toolerator also
+        # clears the ERROR state. NOTE: these statements take precedence over the FSM.
+        if config.homing or config.position_code:
+            if config.keep_reference_on_disable:
+                reference_lost = (self.state != TooleratorStates.READY) & (self.state != TooleratorStates.START)
+            else:
+                reference_lost = 1
+            self.sync += If(
+                ~self.enable & (self.step_generator.speed == 0) & reference_lost,
+                self.homed.eq(0),
+                self.verify_pending.eq(0),
+                self.step_generator.position_target.eq(self.step_generator.position),
+                self.state.eq(TooleratorStates.START)
+            )
+        else:
+            self.sync += If(
+                ~self.enable & (self.step_generator.speed == 0) & (self.state == TooleratorStates.ERROR),
+                self.step_generator.position_target.eq(self.step_generator.position),
+                self.state.eq(TooleratorStates.START)
+            )
+
+        # Log of the state transitions. Each transition is stored with the time (in micro-
+        # seconds since the FPGA has started) and the position of the stepgen in a circular
+        # buffer. The driver reads up to EVENTS_PER_CYCLE transitions each cycle, starting
+        # at `event_read`; transitions which are not read before the buffer wraps around
+        # are lost.
+        if config.events:
+            self.event_time  = Signal(64)
+            self.event_write = Signal(16)
+            self.event_read  = Signal(16)
+            self.event_status_write = Signal(16)
+            self.event_status_read  = Signal(16)
+            self.event_state = [Signal(4) for _ in range(EVENTS_PER_CYCLE)]
+            self.event_stamp = [Signal(32) for _ in range(EVENTS_PER_CYCLE)]
+            self.event_position = [Signal(32) for _ in range(EVENTS_PER_CYCLE)]
+            # Time in micro-seconds
+            cycles_per_us = max(int(round(clock_frequency / 1e6)), 1)
+            prescaler = Signal(max=cycles_per_us + 1)
+            self.sync += If(
+                prescaler == cycles_per_us - 1,
+                prescaler.eq(0),
+                self.event_time.eq(self.event_time + 1)
+            ).Else(
+                prescaler.eq(prescaler + 1)
+            )
+            # Store the state entered, together with the time and position
+            event_prev = Signal(4, reset=TooleratorStates.START)
+            self.specials.event_memory = Memory(4 + 32 + 32, config.events.depth)
+            event_port = self.event_memory.get_port(write_capable=True)
+            self.specials += event_port
+            self.comb += [
+                event_port.we.eq(self.state != event_prev),
+                event_port.adr.eq(self.event_write[:log2_int(config.events.depth)]),
+                event_port.dat_w.eq(Cat(self.state, self.event_time[:32], self.step_generator.position[32:64])),
+            ]
+            self.sync += [
+                event_prev.eq(self.state),
+                If(
+                    self.state != event_prev,
+                    self.event_write.eq(self.event_write + 1)
+                )
+            ]
+            # The transitions read by the driver. A single synchronous read port copies the
+            # EVENTS_PER_CYCLE transitions starting at `event_read` to the registers, one
+            # per clock cycle, so the buffer fits in block RAM. Each pass starts with a
+            # snapshot of both counters and the counters reported to the driver are only
+            # updated at the end of the pass, so they never include a transition which has
+            # not been copied yet. A pass takes EVENTS_PER_CYCLE + 2 clock cycles, which is
+            # far shorter than the time between writing `event_read` and reading the data.
+            read_port = self.event_memory.get_port()
+            self.specials += read_port
+            pass_index = Signal(max=EVENTS_PER_CYCLE + 2)
+            pass_write = Signal(16)
+            pass_read  = Signal(16)
+            self.comb += read_port.adr.eq((pass_read + pass_index - 1)[:log2_int(config.events.depth)])
+            self.sync += [
+                If(
+                    pass_index == 0,
+                    pass_write.eq(self.event_write),
+                    pass_read.eq(self.event_read)
                 ),
-                # Wait until the stepper motor has stopped again. This time the back off distance has been reached
+                # The data of the address set in the previous clock cycle
+                *[If(
+                    pass_index == event + 2,
+                    self.event_state[event].eq(read_port.dat_r[0:4]),
+                    self.event_stamp[event].eq(read_port.dat_r[4:36]),
+                    self.event_position[event].eq(read_port.dat_r[36:68]),
+                ) for event in range(EVENTS_PER_CYCLE)],
                 If(
-                    self.step_generator.position_mode.eq(1) & self.step_generator.stopped,
-                    # Go to the next phase, which will lock the tool.
-                    self.state.eq(TooleratorStates.MOVING_FORWARD)
+                    pass_index == EVENTS_PER_CYCLE + 1,
+                    pass_index.eq(0),
+                    self.event_status_write.eq(pass_write),
+                    self.event_status_read.eq(pass_read)
+                ).Else(
+                    pass_index.eq(pass_index + 1)
                 )
+            ]
+
+
+    @staticmethod
+    def create_register(csr_type, register: LayoutRegister, index):
+        """Creates the CSR for the given register of the layout, see 
+        `litexcnc_toolerator.config.layout`. The layout is shared with the driver.
+        """
+        name = f'toolerator_{index}_{register.name}'
+        if register.fields is None:
+            return csr_type(
+                size=32,
+                name=name,
+                description=register.description.format(index=index)
             )
+        return csr_type(
+            fields=[
+                CSRField(field.name, size=field.size, offset=field.offset, description=field.description)
+                for field in register.fields
+            ],
+            name=name,
+            description=register.description.format(index=index)
+        )
 
+    @staticmethod
+    def event_registers(event):
+        """Returns the registers of a single state transition read by the driver, see 
+        `litexcnc_toolerator.config.layout.EVENT_REGISTERS`.
+        """
+        return [
+            register._replace(
+                name=f'event_{event}_{register.name}',
+                description=register.description.replace('{event}', str(event))
+            )
+            for register in EVENT_REGISTERS
+        ]
 
     @classmethod
     def add_mmio_config_registers(cls, mmio, config):
@@ -267,8 +1365,9 @@ class TooleratorModule(Module, AutoDoc):
         if not config.instances:
             return
 
-        # Function left empty as there is no config data written to the
-        # toolerator
+        for index in range(len(config.instances)):
+            for register in CONFIG_REGISTERS:
+                setattr(mmio, f'toolerator_{index}_{register.name}', cls.create_register(CSRStorage, register, index))
 
     
     @classmethod
@@ -290,22 +1389,14 @@ class TooleratorModule(Module, AutoDoc):
         if not config.instances:
             return
 
-        for index in range(len(config.instances)):
-            setattr(
-                mmio,
-                f'toolerator_{index}_data',
-                CSRStorage(
-                    fields=[
-                        CSRField("tool_number", size=8, offset=0, description="The requested tool."),
-                        CSRField("tool_change", size=1, offset=8, description="Indication that tool change is requested."),
-                        CSRField("enabled", size=1, offset=16, description="Indication that toolchanger is enabled."),
-
-                    ],
-                    name=f'toolerator_{index}_data',
-                    description="Toolerator write data"
-                    f"Toolchange data for toolerator {index}."
-                )
-            )
+        for index, instance_config in enumerate(config.instances):
+            registers = list(WRITE_REGISTERS)
+            if instance_config.tool_width > 8:
+                registers += WRITE_HIGH_REGISTERS
+            if instance_config.events:
+                registers += WRITE_EVENT_REGISTERS
+            for register in registers:
+                setattr(mmio, f'toolerator_{index}_{register.name}', cls.create_register(CSRStorage, register, index))
 
     @classmethod
     def add_mmio_read_registers(cls, mmio, config):
@@ -326,21 +1417,16 @@ class TooleratorModule(Module, AutoDoc):
         if not config.instances:
             return
 
-        for index in range(len(config.instances)):
-            setattr(
-                mmio,
-                f'toolerator_{index}_status',
-                CSRStatus(
-                    fields=[
-                        CSRField("status", size=4, offset=0, description="Tool changer status."),
-                        CSRField("homed", size=1, offset=8, description="Tool changer has been homed."),
-                        CSRField("tool_number", size=8, offset=16, description="The current selected tool."),
-                    ],
-                    name=f'toolerator_{index}_status',
-                    description="toolerator instance status"
-                    f"Status of the toolerator {index}."
-                )
-            )
+        for index, instance_config in enumerate(config.instances):
+            registers = list(READ_REGISTERS)
+            if instance_config.tool_width > 8:
+                registers += READ_HIGH_REGISTERS
+            if instance_config.events:
+                registers += READ_EVENT_REGISTERS
+                for event in range(EVENTS_PER_CYCLE):
+                    registers += cls.event_registers(event)
+            for register in registers:
+                setattr(mmio, f'toolerator_{index}_{register.name}', cls.create_register(CSRStatus, register, index))
 
     @classmethod
     def create_from_config(cls, soc: SoC, watchdog, config: 'TooleratorModuleConfig'):
@@ -363,17 +1449,25 @@ class TooleratorModule(Module, AutoDoc):
         # Create the generators
         for index, instance_config in enumerate(config.instances):
             # Add the io to the FPGA
+            pins = [
+                Subsignal("step", Pins(instance_config.stepgen.pins.step_pin), IOStandard(instance_config.io_standard)),
+                Subsignal("dir",  Pins(instance_config.stepgen.pins.dir_pin),  IOStandard(instance_config.io_standard))
+            ]
             if instance_config.homing:
-                pins = (
-                    Subsignal("step", Pins(instance_config.stepgen.pins.step_pin), IOStandard(instance_config.io_standard)),
-                    Subsignal("dir",  Pins(instance_config.stepgen.pins.dir_pin),  IOStandard(instance_config.io_standard)),
-                    Subsignal("home", Pins(instance_config.homing.home_pin), IOStandard(instance_config.io_standard))
-                )
-            else:
-                pins = (
-                    Subsignal("step", Pins(instance_config.stepgen.pins.step_pin), IOStandard(instance_config.io_standard)),
-                    Subsignal("dir",  Pins(instance_config.stepgen.pins.dir_pin),  IOStandard(instance_config.io_standard))
-                )
+                pins.append(Subsignal("home", Pins(instance_config.homing.home_pin), IOStandard(instance_config.io_standard)))
+            if instance_config.position_code:
+                pins.append(Subsignal("code", Pins(" ".join(instance_config.position_code.code_pins)), IOStandard(instance_config.io_standard)))
+            if instance_config.sequence and instance_config.sequence.input_pins:
+                pins.append(Subsignal("seq_in", Pins(" ".join(instance_config.sequence.input_pins)), IOStandard(instance_config.io_standard)))
+            if instance_config.sequence and instance_config.sequence.output_pins:
+                pins.append(Subsignal("seq_out", Pins(" ".join(instance_config.sequence.output_pins)), IOStandard(instance_config.io_standard)))
+            if instance_config.lock_confirm:
+                pins.append(Subsignal("lock", Pins(instance_config.lock_confirm.lock_pin), IOStandard(instance_config.io_standard)))
+            if instance_config.encoder:
+                pins += [
+                    Subsignal("enc_a", Pins(instance_config.encoder.pin_A), IOStandard(instance_config.io_standard)),
+                    Subsignal("enc_b", Pins(instance_config.encoder.pin_B), IOStandard(instance_config.io_standard))
+                ]
             soc.platform.add_extension([("toolerator", index, *pins)])
             # Create the toolerator
             pads = soc.platform.request("toolerator", index)
@@ -387,12 +1481,68 @@ class TooleratorModule(Module, AutoDoc):
             soc.comb += [
                 # Fields written to toolerator
                 toolerator.enable.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data').fields.enabled & ~watchdog.has_bitten),
-                toolerator.commanded_tool.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data').fields.tool_number),
+                toolerator.commanded_tool[0:8].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data').fields.tool_number),
+                toolerator.tool_change.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data').fields.tool_change),
+                toolerator.home.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data').fields.home),
+                toolerator.queue_tool[0:8].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_queue_data').fields.tool_number),
+                toolerator.queue_push.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_queue_data').fields.push),
+                toolerator.queue_clear.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_queue_data').fields.clear),
+                toolerator.restore_tool.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_restore').fields.tool_number),
+                toolerator.restore_valid.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_restore').fields.valid),
+                toolerator.tune.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_tune_data').fields.tune),
                 # Fiekds read from toolerator
                 getattr(soc.MMIO_inst, f'toolerator_{index}_status').fields.status.eq(toolerator.state),
                 getattr(soc.MMIO_inst, f'toolerator_{index}_status').fields.homed.eq(toolerator.homed),
-                getattr(soc.MMIO_inst, f'toolerator_{index}_status').fields.tool_number.eq(toolerator.current_tool),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_status').fields.tool_number.eq(toolerator.current_tool[0:8]),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_status').fields.moving_to_tool.eq(toolerator.moving_to_tool[0:8]),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_queue_status').fields.level.eq(toolerator.queue.level),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_queue_status').fields.full.eq(~toolerator.queue.writable),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_position').status.eq(toolerator.step_generator.position[32:64]),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_position_fb').status.eq(toolerator.encoder_position[32:64]),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_tune_status').fields.passed.eq(toolerator.tune_passed),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_tune_max_vel').status.eq(toolerator.tune_max_vel),
+                getattr(soc.MMIO_inst, f'toolerator_{index}_tune_max_acc').status.eq(toolerator.tune_max_acc),
             ]
+            if instance_config.homing:
+                soc.comb += getattr(soc.MMIO_inst, f'toolerator_{index}_drift').status.eq(toolerator.home_drift[32:64])
+            if instance_config.carousel:
+                soc.comb += [
+                    toolerator.table_tool[0:8].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_table_data').fields.tool),
+                    toolerator.table_pocket[0:8].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_table_data').fields.pocket),
+                    toolerator.table_write.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_table_data').fields.write),
+                ]
+            if instance_config.tool_width > 8:
+                # The upper bytes of the tool numbers are exchanged in separate registers
+                soc.comb += [
+                    toolerator.commanded_tool[8:16].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data_high').fields.tool_number),
+                    toolerator.queue_tool[8:16].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data_high').fields.queue_tool_number),
+                    getattr(soc.MMIO_inst, f'toolerator_{index}_status_high').fields.tool_number.eq(toolerator.current_tool[8:16]),
+                    getattr(soc.MMIO_inst, f'toolerator_{index}_status_high').fields.moving_to_tool.eq(toolerator.moving_to_tool[8:16]),
+                ]
+                if instance_config.carousel:
+                    soc.comb += [
+                        toolerator.table_tool[8:16].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data_high').fields.table_tool),
+                        toolerator.table_pocket[8:16].eq(getattr(soc.MMIO_inst, f'toolerator_{index}_data_high').fields.table_pocket),
+                    ]
+            if instance_config.events:
+                soc.comb += [
+                    toolerator.event_read.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_event_data').fields.read),
+                    getattr(soc.MMIO_inst, f'toolerator_{index}_event_status').fields.write.eq(toolerator.event_status_write),
+                    getattr(soc.MMIO_inst, f'toolerator_{index}_event_status').fields.read.eq(toolerator.event_status_read),
+                    getattr(soc.MMIO_inst, f'toolerator_{index}_event_time_high').status.eq(toolerator.event_time[32:64]),
+                    getattr(soc.MMIO_inst, f'toolerator_{index}_event_time_low').status.eq(toolerator.event_time[0:32]),
+                ]
+                for event in range(EVENTS_PER_CYCLE):
+                    soc.comb += [
+                        getattr(soc.MMIO_inst, f'toolerator_{index}_event_{event}_state').fields.state.eq(toolerator.event_state[event]),
+                        getattr(soc.MMIO_inst, f'toolerator_{index}_event_{event}_time').status.eq(toolerator.event_stamp[event]),
+                        getattr(soc.MMIO_inst, f'toolerator_{index}_event_{event}_position').status.eq(toolerator.event_position[event]),
+                    ]
+            if instance_config.scope:
+                # The capture is read using its own registers, outside the MMIO
+                scope = TooleratorScope(instance_config.scope, toolerator.step_generator, toolerator.state)
+                setattr(soc.submodules, f'toolerator_{index}_scope', scope)
+                soc.comb += scope.arm.eq(getattr(soc.MMIO_inst, f'toolerator_{index}_tune_data').fields.scope_arm)
 
 
 if __name__ == "__main__":
@@ -404,6 +1554,7 @@ if __name__ == "__main__":
         # Setup the stepgen
         yield(toolerator.enable.eq(1))
         yield(toolerator.commanded_tool.eq(1))
+        yield(toolerator.tool_change.eq(1))
 
 
         with open('test.csv', 'w') as csv_file:
@@ -444,7 +1595,13 @@ if __name__ == "__main__":
                 "dir_setup_time": 800, 
             },
         },
-        homing=None
+        homing=None,
+        position_code=None,
+        encoder=None,
+        lock_confirm=None,
+        carousel=None,
+        sequence=None,
+        tuning=None
     )
 
     toolerator = TooleratorModule(config, pick_off=(32, 40, 48), clock_frequency=40e6)
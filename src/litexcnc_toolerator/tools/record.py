@@ -0,0 +1,165 @@
+"""
+Turret style tool changer driven by stepper motor
+
+Author: Peter van Tol <petertgvantol@gmail.com>
+License: GPL Version 2
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of version 2 of the GNU General
+Public License as published by the Free Software Foundation.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+THE AUTHORS OF THIS LIBRARY ACCEPT ABSOLUTELY NO LIABILITY FOR
+ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE
+TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of
+harming persons must have provisions for completely removing power
+from all motors, etc, before persons enter any danger area.  All
+machinery must be designed to comply with local and national safety
+codes, and the authors of this software can not, and do not, take
+any responsibility for such compliance.
+
+This code was written as part of the LiteX-CNC project.
+
+Copyright (c) 2023 All rights reserved.
+"""
+# Imports for the command line
+import argparse
+import ctypes
+import struct
+import sys
+import time
+
+# Key and layout of the recording, must be equal to litexcnc_toolerator.h
+RECORD_KEY = 0x52454330
+RECORD_MAGIC = 0x52454331
+
+# Header of the file with the recording, must be equal to tools/replay/replay.c
+FILE_MAGIC = b'LTRL'
+FILE_VERSION = 1
+
+
+class RecordHeader(ctypes.Structure):
+    _fields_ = [
+        ('magic', ctypes.c_uint32),
+        ('slots', ctypes.c_uint32),
+        ('slot_size', ctypes.c_uint32),
+        ('config_size', ctypes.c_uint32),
+        ('head', ctypes.c_uint64),
+    ]
+
+
+def align(size: int) -> int:
+    """Rounds the size up to a multiple of 8 bytes, the alignment of the slots."""
+    return (size + 7) & ~7
+
+
+class RecordReader:
+    """Reader of the frames recorded by the driver in shared memory. The reader never
+    writes to the ring, so the servo-thread is never blocked. Frames which have been
+    overwritten before they were read are counted in `lost`.
+    """
+
+    def __init__(self, board: int):
+        self.hal = ctypes.CDLL('liblinuxcnchal.so.0')
+        self.comp_id = self.hal.hal_init(b'toolerator-record')
+        if self.comp_id < 0:
+            raise RuntimeError("Cannot connect to the HAL, is LinuxCNC running?")
+        self.hal.hal_ready(self.comp_id)
+        # The size of the ring is not known in advance: first the header is opened to
+        # get the size, after which the complete ring is opened
+        self.key = RECORD_KEY + board
+        self.shmem_id = self.open(ctypes.sizeof(RecordHeader))
+        header = RecordHeader.from_address(self.pointer)
+        if header.magic != RECORD_MAGIC:
+            self.close()
+            raise RuntimeError("The layout of the recording differs from the driver, re-install the driver.")
+        self.slots, self.slot_size, self.config_size = header.slots, header.slot_size, header.config_size
+        self.hal.rtapi_shmem_delete(self.shmem_id, self.comp_id)
+        self.shmem_id = self.open(
+            ctypes.sizeof(RecordHeader) + align(self.config_size) + self.slots * self.slot_size
+        )
+        self.header = RecordHeader.from_address(self.pointer)
+        self.config = ctypes.string_at(self.pointer + ctypes.sizeof(RecordHeader), self.config_size)
+        self.slots_address = self.pointer + ctypes.sizeof(RecordHeader) + align(self.config_size)
+        # Start with the oldest frame still in the ring
+        self.tail = max(0, self.header.head - self.slots)
+        self.lost = 0
+
+    def open(self, size):
+        shmem_id = self.hal.rtapi_shmem_new(self.key, self.comp_id, size)
+        if shmem_id < 0:
+            self.hal.hal_exit(self.comp_id)
+            raise RuntimeError("Cannot open the recording, load the driver with `record=1`.")
+        pointer = ctypes.c_void_p()
+        self.hal.rtapi_shmem_getptr(shmem_id, ctypes.byref(pointer))
+        self.pointer = pointer.value
+        return shmem_id
+
+    def close(self):
+        self.hal.rtapi_shmem_delete(self.shmem_id, self.comp_id)
+        self.hal.hal_exit(self.comp_id)
+
+    def read(self):
+        """Returns the index and the content of the frames written since the previous 
+        call.
+        """
+        frames = []
+        head = self.header.head
+        if head - self.tail > self.slots:
+            self.lost += head - self.slots - self.tail
+            self.tail = head - self.slots
+        while self.tail < head:
+            frame = ctypes.string_at(self.slots_address + (self.tail % self.slots) * self.slot_size, self.slot_size)
+            # The frame may have been overwritten while copying it, when the servo-thread
+            # has reached its slot again
+            if self.header.head - self.tail >= self.slots:
+                self.lost += 1
+            else:
+                frames.append((self.tail, frame))
+            self.tail += 1
+        return frames
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description="Writes the inputs and the data exchanged with the FPGA of each cycle "
+        "to a file, until interrupted. Load the driver with `record=1` to enable the "
+        "recording. The file can be replayed with the harness in `tools/replay`."
+    )
+    parser.add_argument("output", help="The file to write the recording to.")
+    parser.add_argument("--board", type=int, default=0, help="The index of the board.")
+    parser.add_argument("--interval", type=float, default=0.1, help="Time (in seconds) between reading the ring.")
+    args = parser.parse_args(argv)
+
+    try:
+        reader = RecordReader(args.board)
+    except RuntimeError as error:
+        print(error, file=sys.stderr)
+        return 1
+    with open(args.output, 'wb') as file:
+        file.write(struct.pack('<4sIII', FILE_MAGIC, FILE_VERSION, reader.slot_size, reader.config_size))
+        file.write(reader.config)
+        try:
+            while True:
+                for index, frame in reader.read():
+                    file.write(struct.pack('<Q', index))
+                    file.write(frame)
+                time.sleep(args.interval)
+        except KeyboardInterrupt:
+            pass
+        finally:
+            reader.close()
+    if reader.lost:
+        print(f"{reader.lost} frames have been overwritten before these were read.", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,54 @@
+/********************************************************************
+* Description:  hal.h
+*               Mock of the HAL for the replay of the toolerator driver.
+*               Pins are allocated on the heap and are not connected
+*               to signals; the replay sets the inputs directly.
+********************************************************************/
+#ifndef __INCLUDE_MOCK_HAL_H__
+#define __INCLUDE_MOCK_HAL_H__
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HAL_NAME_LEN 47
+
+typedef volatile bool hal_bit_t;
+typedef volatile uint32_t hal_u32_t;
+typedef volatile int32_t hal_s32_t;
+typedef double real_t;
+typedef volatile real_t hal_float_t;
+
+typedef enum { HAL_IN = 16, HAL_OUT = 32, HAL_IO = (HAL_IN | HAL_OUT) } hal_pin_dir_t;
+typedef enum { HAL_RO = 64, HAL_RW = 192 } hal_param_dir_t;
+
+static inline int hal_init(const char *name) { (void) name; return 1; }
+static inline int hal_ready(int comp_id) { (void) comp_id; return 0; }
+static inline int hal_exit(int comp_id) { (void) comp_id; return 0; }
+static inline void *hal_malloc(long size) { return calloc(1, size); }
+
+#define MOCK_HAL_PIN_NEW(type) \
+    static inline int hal_pin_##type##_new(const char *name, hal_pin_dir_t dir, hal_##type##_t **data_ptr_addr, int comp_id) { \
+        (void) name; (void) dir; (void) comp_id; \
+        *data_ptr_addr = (hal_##type##_t *) calloc(1, sizeof(hal_##type##_t)); \
+        return (*data_ptr_addr == NULL) ? -ENOMEM : 0; \
+    }
+MOCK_HAL_PIN_NEW(bit)
+MOCK_HAL_PIN_NEW(u32)
+MOCK_HAL_PIN_NEW(s32)
+MOCK_HAL_PIN_NEW(float)
+
+#define MOCK_HAL_PARAM_NEW(type) \
+    static inline int hal_param_##type##_new(const char *name, hal_param_dir_t dir, hal_##type##_t *data_addr, int comp_id) { \
+        (void) name; (void) dir; (void) data_addr; (void) comp_id; \
+        return 0; \
+    }
+MOCK_HAL_PARAM_NEW(bit)
+MOCK_HAL_PARAM_NEW(u32)
+MOCK_HAL_PARAM_NEW(s32)
+MOCK_HAL_PARAM_NEW(float)
+
+#endif
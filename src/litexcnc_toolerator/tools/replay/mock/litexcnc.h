@@ -0,0 +1,68 @@
+/********************************************************************
+* Description:  litexcnc.h
+*               Mock of LitexCNC for the replay of the toolerator 
+*               driver. Only the parts used by the driver are defined.
+********************************************************************/
+#ifndef __INCLUDE_MOCK_LITEXCNC_H__
+#define __INCLUDE_MOCK_LITEXCNC_H__
+
+#include <endian.h>
+#include <stdio.h>
+
+#include "hal.h"
+#include "rtapi.h"
+
+#define LITEXCNC_NAME "litexcnc"
+
+#define LITEXCNC_PRINT_NO_DEVICE(fmt, ...) printf(LITEXCNC_NAME ": " fmt, ## __VA_ARGS__)
+#define LITEXCNC_ERR_NO_DEVICE(fmt, ...) fprintf(stderr, LITEXCNC_NAME ": " fmt, ## __VA_ARGS__)
+
+#define LITEXCNC_CREATE_BASENAME(module_name, index) \
+    rtapi_snprintf(base_name, sizeof(base_name), "%s.%s.%zu", litexcnc->fpga->name, module_name, (size_t) index)
+
+#define LITEXCNC_CREATE_HAL_PIN(pin_name, hal_type, hal_dir, pin_addr) \
+    rtapi_snprintf(name, sizeof(name), "%s.%s", base_name, pin_name); \
+    r = hal_pin_##hal_type##_new(name, hal_dir, pin_addr, comp_id); \
+    if (r < 0) { \
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s', aborting\n", name); \
+        return r; \
+    }
+
+#define LITEXCNC_CREATE_HAL_PARAM(param_name, hal_type, hal_dir, param_addr) \
+    rtapi_snprintf(name, sizeof(name), "%s.%s", base_name, param_name); \
+    r = hal_param_##hal_type##_new(name, hal_dir, param_addr, comp_id); \
+    if (r < 0) { \
+        LITEXCNC_ERR_NO_DEVICE("Error adding param '%s', aborting\n", name); \
+        return r; \
+    }
+
+typedef struct {
+    char name[HAL_NAME_LEN + 1];
+} litexcnc_fpga_t;
+
+typedef struct {
+    litexcnc_fpga_t *fpga;
+} litexcnc_t;
+
+typedef struct {
+    int (*prepare_write)(void *instance, uint8_t **data, int period);
+    int (*process_read)(void *instance, uint8_t **data, int period);
+    int (*configure_module)(void *instance, uint8_t **data, int period);
+    void *instance_data;
+} litexcnc_module_instance_t;
+
+typedef struct {
+    uint32_t id;
+    char name[HAL_NAME_LEN + 1];
+    size_t (*initialize)(litexcnc_module_instance_t **instance, litexcnc_t *litexcnc, uint8_t **config);
+    size_t (*required_config_buffer)(void *instance);
+    size_t (*required_write_buffer)(void *instance);
+    size_t (*required_read_buffer)(void *instance);
+} litexcnc_module_registration_t;
+
+static inline int litexcnc_register_module(litexcnc_module_registration_t *registration) {
+    (void) registration;
+    return 0;
+}
+
+#endif
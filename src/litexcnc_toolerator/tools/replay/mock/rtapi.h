@@ -0,0 +1,42 @@
+/********************************************************************
+* Description:  rtapi.h
+*               Mock of the RTAPI for the replay of the toolerator 
+*               driver. Shared memory is not available, so the trace
+*               and the recording cannot be enabled during a replay.
+********************************************************************/
+#ifndef __INCLUDE_MOCK_RTAPI_H__
+#define __INCLUDE_MOCK_RTAPI_H__
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#define rtapi_print printf
+
+static inline int rtapi_snprintf(char *buffer, unsigned long size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int result = vsnprintf(buffer, size, format, args);
+    va_end(args);
+    return result;
+}
+
+#define EXPORT_SYMBOL_GPL(symbol)
+#define RTAPI_MP_INT(var, description)
+#define RTAPI_MP_STRING(var, description)
+
+static inline int rtapi_shmem_new(int key, int module_id, unsigned long size) { 
+    (void) key; (void) module_id; (void) size;
+    return -ENOSYS; 
+}
+static inline int rtapi_shmem_getptr(int handle, void **ptr) { (void) handle; (void) ptr; return -ENOSYS; }
+static inline int rtapi_shmem_delete(int handle, int module_id) { (void) handle; (void) module_id; return 0; }
+
+static inline long long rtapi_get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,5 @@
+/********************************************************************
+* Description:  rtapi_app.h
+*               Mock of the RTAPI for the replay of the toolerator 
+*               driver.
+********************************************************************/
@@ -0,0 +1,6 @@
+/********************************************************************
+* Description:  rtapi_string.h
+*               Mock of the RTAPI for the replay of the toolerator 
+*               driver.
+********************************************************************/
+#include <string.h>
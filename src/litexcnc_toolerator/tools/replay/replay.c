@@ -0,0 +1,219 @@
+/********************************************************************
+* Description:  replay.c
+*               Replay of a recording through the toolerator driver
+*
+* Author: Peter van Tol <petertgvantol@gmail.com>
+* License: GPL Version 2
+*    
+* Copyright (c) 2023 All rights reserved.
+*
+********************************************************************/
+
+/** This program is free software; you can redistribute it and/or
+    modify it under the terms of version 2 of the GNU General
+    Public License as published by the Free Software Foundation.
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    THE AUTHORS OF THIS LIBRARY ACCEPT ABSOLUTELY NO LIABILITY FOR
+    ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE
+    TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of
+    harming persons must have provisions for completely removing power
+    from all motors, etc, before persons enter any danger area.  All
+    machinery must be designed to comply with local and national safety
+    codes, and the authors of this software can not, and do not, take
+    any responsibility for such compliance.
+
+    This code was written as part of the LiteX-CNC project.
+*/
+
+/*******************************************************************************
+ * Replays a recording made with `litexcnc-toolerator-record` through the driver.
+ * The driver is compiled unchanged against a mock of the HAL, RTAPI and LitexCNC 
+ * (see the folder `mock`). For each frame, the recorded inputs are copied to the 
+ * pins before the function of the driver is called:
+ * - read frames are processed with litexcnc_toolerator_process_read();
+ * - for write frames, litexcnc_toolerator_prepare_write() is called and its data 
+ *   is compared with the recorded data. Differences are reported.
+ * The duration of each call is measured, so changes of the driver can be profiled
+ * against a recording.
+ *
+ * Build and run with:
+ *
+ *     make
+ *     ./replay <recording>
+ ******************************************************************************/
+#include "litexcnc_toolerator.c"
+
+#include <stdlib.h>
+
+/** Header of a recording, see litexcnc_toolerator/tools/record.py */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t config_size;
+} replay_header_t;
+
+#define REPLAY_MAGIC "LTRL"
+#define REPLAY_VERSION 1
+
+/** Statistics of the duration of the calls to a function of the driver */
+typedef struct {
+    size_t calls;
+    long long min;
+    long long max;
+    long long total;
+} replay_timing_t;
+
+
+static void replay_timing_add(replay_timing_t *timing, long long duration) {
+    if ((timing->calls == 0) || (duration < timing->min)) timing->min = duration;
+    if ((timing->calls == 0) || (duration > timing->max)) timing->max = duration;
+    timing->total += duration;
+    timing->calls++;
+}
+
+
+static void replay_timing_print(const char *name, replay_timing_t *timing) {
+    if (timing->calls == 0) {
+        return;
+    }
+    printf(
+        "%-14s %8zu calls, min %6lld ns, avg %6lld ns, max %6lld ns\n", 
+        name, timing->calls, timing->min, timing->total / (long long) timing->calls, timing->max
+    );
+}
+
+
+/** Copies the recorded inputs to the pins and params of the instances */
+static void replay_inputs(litexcnc_toolerator_t *toolerator, litexcnc_toolerator_record_inputs_t *inputs) {
+    for (size_t i=0; i<toolerator->num_instances; i++) {
+        litexcnc_toolerator_instance_t *instance = &(toolerator->instances[i]);
+        *(instance->hal.pin.enable) = inputs[i].enable;
+        *(instance->hal.pin.home) = inputs[i].home;
+        *(instance->hal.pin.tool_change) = inputs[i].tool_change;
+        *(instance->hal.pin.queue_push) = inputs[i].queue_push;
+        *(instance->hal.pin.queue_clear) = inputs[i].queue_clear;
+        *(instance->hal.pin.tune) = inputs[i].tune;
+        *(instance->hal.pin.table_write) = inputs[i].table_write;
+        if (instance->data.scope) {
+            *(instance->hal.pin.scope_arm) = inputs[i].scope_arm;
+        }
+        *(instance->hal.pin.tool_number) = inputs[i].tool_number;
+        *(instance->hal.pin.queue_tool_number) = inputs[i].queue_tool_number;
+        *(instance->hal.pin.table_tool) = inputs[i].table_tool;
+        *(instance->hal.pin.table_pocket) = inputs[i].table_pocket;
+        instance->hal.param.tune_margin = inputs[i].tune_margin;
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <recording>\n", argv[0]);
+        return 2;
+    }
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+
+    // Read the header and the config block of the recording
+    replay_header_t header;
+    if ((fread(&header, sizeof(header), 1, file) != 1) || 
+        (memcmp(header.magic, REPLAY_MAGIC, 4) != 0) || 
+        (header.version != REPLAY_VERSION)) {
+        fprintf(stderr, "%s is not a recording of the toolerator\n", argv[1]);
+        return 2;
+    }
+    uint8_t *config = malloc(header.config_size);
+    uint8_t *slot = malloc(header.slot_size);
+    uint8_t *data = malloc(header.slot_size);
+    if ((config == NULL) || (slot == NULL) || (data == NULL) || 
+        (fread(config, header.config_size, 1, file) != 1)) {
+        fprintf(stderr, "Cannot read the config block of %s\n", argv[1]);
+        return 2;
+    }
+
+    // Load the driver and initialise the board with the recorded config block
+    litexcnc_fpga_t fpga;
+    rtapi_snprintf(fpga.name, sizeof(fpga.name), "replay");
+    litexcnc_t litexcnc = { .fpga = &fpga };
+    if (rtapi_app_main() < 0) {
+        return 2;
+    }
+    litexcnc_module_instance_t *module;
+    uint8_t *config_pointer = config;
+    if ((int) litexcnc_toolerator_init(&module, &litexcnc, &config_pointer) < 0) {
+        fprintf(stderr, "The driver refused the config block of %s\n", argv[1]);
+        return 2;
+    }
+    litexcnc_toolerator_t *toolerator = (litexcnc_toolerator_t *) module->instance_data;
+    size_t inputs_size = toolerator->num_instances * sizeof(litexcnc_toolerator_record_inputs_t);
+
+    // Replay the frames
+    replay_timing_t read_timing = {0}, write_timing = {0};
+    size_t frames = 0, gaps = 0, differences = 0;
+    uint64_t expected = 0;
+    uint64_t index;
+    while ((fread(&index, sizeof(index), 1, file) == 1) && (fread(slot, header.slot_size, 1, file) == 1)) {
+        litexcnc_toolerator_record_frame_t *frame = (litexcnc_toolerator_record_frame_t *) slot;
+        litexcnc_toolerator_record_inputs_t *inputs = (litexcnc_toolerator_record_inputs_t *) (slot + sizeof(litexcnc_toolerator_record_frame_t));
+        uint8_t *recorded = slot + sizeof(litexcnc_toolerator_record_frame_t) + inputs_size;
+        if (index != expected) {
+            // Frames have been lost while recording, the state of the driver might differ
+            // from the state during the recording from here on
+            printf("frame %" PRIu64 ": %" PRIu64 " frames missing\n", index, index - expected);
+            gaps++;
+        }
+        expected = index + 1;
+        frames++;
+
+        replay_inputs(toolerator, inputs);
+        uint8_t *pointer = data;
+        long long start;
+        switch (frame->type) {
+            case LITEXCNC_TOOLERATOR_RECORD_READ:
+                memcpy(data, recorded, frame->size);
+                start = rtapi_get_time();
+                module->process_read(toolerator, &pointer, frame->period);
+                replay_timing_add(&read_timing, rtapi_get_time() - start);
+                break;
+            case LITEXCNC_TOOLERATOR_RECORD_WRITE:
+                memset(data, 0, frame->size);
+                start = rtapi_get_time();
+                module->prepare_write(toolerator, &pointer, frame->period);
+                replay_timing_add(&write_timing, rtapi_get_time() - start);
+                for (size_t word=0; word<frame->size / 4; word++) {
+                    if (memcmp(data + 4 * word, recorded + 4 * word, 4) != 0) {
+                        uint32_t expected_word, actual_word;
+                        memcpy(&expected_word, recorded + 4 * word, 4);
+                        memcpy(&actual_word, data + 4 * word, 4);
+                        printf(
+                            "frame %" PRIu64 ": word %zu written as %08" PRIx32 ", recorded %08" PRIx32 "\n",
+                            index, word, be32toh(actual_word), be32toh(expected_word)
+                        );
+                        differences++;
+                    }
+                }
+                break;
+            default:
+                printf("frame %" PRIu64 ": unknown type %" PRIu32 "\n", index, frame->type);
+        }
+    }
+    fclose(file);
+
+    // Summary
+    printf("%zu frames replayed, %zu gaps, %zu differences\n", frames, gaps, differences);
+    replay_timing_print("process_read", &read_timing);
+    replay_timing_print("prepare_write", &write_timing);
+    return (differences > 0) ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+"""
+Turret style tool changer driven by stepper motor
+
+Author: Peter van Tol <petertgvantol@gmail.com>
+License: GPL Version 2
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of version 2 of the GNU General
+Public License as published by the Free Software Foundation.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+THE AUTHORS OF THIS LIBRARY ACCEPT ABSOLUTELY NO LIABILITY FOR
+ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE
+TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of
+harming persons must have provisions for completely removing power
+from all motors, etc, before persons enter any danger area.  All
+machinery must be designed to comply with local and national safety
+codes, and the authors of this software can not, and do not, take
+any responsibility for such compliance.
+
+This code was written as part of the LiteX-CNC project.
+
+Copyright (c) 2023 All rights reserved.
+"""
+# Imports for the command line
+import argparse
+import csv
+import sys
+import time
+
+
+def to_signed(value: int) -> int:
+    """Converts a 32-bit register value to a signed integer."""
+    return value - (1 << 32) if value & (1 << 31) else value
+
+
+def wait_for_capture(scope, timeout: float) -> int:
+    """Waits until the capture has finished and returns the number of samples. The
+    capture is armed by the driver (pin `scope-arm`) and starts at the next move or
+    homing of the toolerator.
+    """
+    deadline = time.monotonic() + timeout
+    while True:
+        status = scope('status').read()
+        if status & 0x04:
+            return status >> 16
+        if time.monotonic() > deadline:
+            raise TimeoutError(
+                "Capture has not finished, arm the capture with the pin `scope-arm` and "
+                "start a tool change or homing."
+            )
+        time.sleep(0.1)
+
+
+def read_capture(bus, index: int, timeout: float):
+    """Reads the samples of the capture of the given toolerator. The samples are read
+    one by one using the registers of the scope, these are not part of the data
+    exchanged by the driver each cycle. Yields the samples in the units of the stepgen
+    simulation: time in seconds, speed in steps per second and the distances in steps.
+    """
+    def scope(name):
+        return getattr(bus.regs, f'toolerator_{index}_scope_{name}')
+
+    level = wait_for_capture(scope, timeout)
+    config = scope('config').read()
+    decimation = config >> 16
+    clock_frequency = bus.constants.config_clock_frequency
+    for sample in range(level):
+        scope('index').write(sample)
+        yield (
+            sample,
+            sample * decimation / clock_frequency,
+            to_signed(scope('speed').read()) * clock_frequency / (1 << 32),
+            to_signed(scope('position').read()) / (1 << 8),
+            to_signed(scope('dtg').read()) / (1 << 8),
+            to_signed(scope('acc_distance').read()) / (1 << 8),
+        )
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description="Reads the capture of the trajectory of a toolerator into a CSV-file. "
+        "The board is accessed through a running `litex_server`, next to LinuxCNC."
+    )
+    parser.add_argument("output", help="The CSV-file to write the capture to.")
+    parser.add_argument("--index", type=int, default=0, help="The index of the toolerator.")
+    parser.add_argument("--csr-csv", default="csr.csv", help="The CSR definitions of the firmware.")
+    parser.add_argument("--host", default="localhost", help="Host of the litex_server.")
+    parser.add_argument("--port", type=int, default=1234, help="Port of the litex_server.")
+    parser.add_argument("--timeout", type=float, default=60, help="Time (in seconds) to wait for the capture.")
+    args = parser.parse_args(argv)
+
+    # Deferred imports to prevent importing Litex when only the help is requested
+    from litex import RemoteClient
+
+    bus = RemoteClient(host=args.host, port=args.port, csr_csv=args.csr_csv)
+    bus.open()
+    try:
+        with open(args.output, 'w', newline='') as csv_file:
+            writer = csv.writer(csv_file)
+            writer.writerow(["sample", "time", "speed", "position", "dtg", "acc_distance"])
+            for row in read_capture(bus, args.index, args.timeout):
+                writer.writerow(row)
+    except TimeoutError as error:
+        print(error, file=sys.stderr)
+        return 1
+    finally:
+        bus.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
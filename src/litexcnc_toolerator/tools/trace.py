@@ -0,0 +1,264 @@
+"""
+Turret style tool changer driven by stepper motor
+
+Author: Peter van Tol <petertgvantol@gmail.com>
+License: GPL Version 2
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of version 2 of the GNU General
+Public License as published by the Free Software Foundation.
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+THE AUTHORS OF THIS LIBRARY ACCEPT ABSOLUTELY NO LIABILITY FOR
+ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE
+TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of
+harming persons must have provisions for completely removing power
+from all motors, etc, before persons enter any danger area.  All
+machinery must be designed to comply with local and national safety
+codes, and the authors of this software can not, and do not, take
+any responsibility for such compliance.
+
+This code was written as part of the LiteX-CNC project.
+
+Copyright (c) 2023 All rights reserved.
+"""
+# Imports for the command line
+import argparse
+import csv
+import ctypes
+import json
+import platform
+import sys
+import time
+
+# Local imports
+from litexcnc_toolerator.config.layout import TooleratorStates
+
+# Key and layout of the trace, must be equal to litexcnc_toolerator.h
+TRACE_KEY = 0x54524143
+TRACE_MAGIC = 0x54524331
+TRACE_RECORDS = 4096
+TRACE_STATUS = 0x01
+TRACE_COMMAND = 0x02
+TRACE_INPUTS = ['enable', 'tool-change', 'home', 'tune', 'queue-push', 'queue-clear']
+
+# The reader has no memory barriers (see TraceReader.read), which is only safe with the
+# strong ordering of the loads on x86
+TRACE_MACHINES = ['x86_64', 'amd64', 'i386', 'i686']
+
+
+class TraceRecord(ctypes.Structure):
+    _fields_ = [
+        ('time', ctypes.c_uint64),
+        ('board', ctypes.c_uint16),
+        ('instance', ctypes.c_uint16),
+        ('type', ctypes.c_uint8),
+        ('status', ctypes.c_uint8),
+        ('inputs', ctypes.c_uint8),
+        ('queue_level', ctypes.c_uint8),
+        ('tool', ctypes.c_uint32),
+        ('target', ctypes.c_uint32),
+        ('position', ctypes.c_float),
+        ('period', ctypes.c_uint32),
+    ]
+
+
+class Trace(ctypes.Structure):
+    _fields_ = [
+        ('magic', ctypes.c_uint32),
+        ('size', ctypes.c_uint32),
+        ('record_size', ctypes.c_uint32),
+        ('reserved', ctypes.c_uint32),
+        ('head', ctypes.c_uint64),
+        ('records', TraceRecord * TRACE_RECORDS),
+    ]
+
+
+class TraceReader:
+    """Reader of the trace of a single board written by the driver in shared memory. 
+    The reader never writes to the trace, so the driver is never blocked. Records which
+    have been overwritten before they were read are counted in `lost`.
+    """
+
+    def __init__(self, board: int):
+        if platform.machine().lower() not in TRACE_MACHINES:
+            raise RuntimeError(
+                f"The trace can only be read on x86 hosts, not on {platform.machine()}."
+            )
+        self.hal = ctypes.CDLL('liblinuxcnchal.so.0')
+        self.comp_id = self.hal.hal_init(b'toolerator-trace')
+        if self.comp_id < 0:
+            raise RuntimeError("Cannot connect to the HAL, is LinuxCNC running?")
+        self.hal.hal_ready(self.comp_id)
+        self.shmem_id = self.hal.rtapi_shmem_new(TRACE_KEY + board, self.comp_id, ctypes.sizeof(Trace))
+        if self.shmem_id < 0:
+            self.hal.hal_exit(self.comp_id)
+            raise RuntimeError(f"Cannot open the trace of board {board}, load the driver with `trace=1`.")
+        pointer = ctypes.c_void_p()
+        self.hal.rtapi_shmem_getptr(self.shmem_id, ctypes.byref(pointer))
+        self.trace = Trace.from_address(pointer.value)
+        if (self.trace.magic != TRACE_MAGIC or 
+                self.trace.size != TRACE_RECORDS or 
+                self.trace.record_size != ctypes.sizeof(TraceRecord)):
+            self.close()
+            raise RuntimeError("The layout of the trace differs from the driver, re-install the driver.")
+        # Start with the records still in the ring
+        self.tail = max(0, self.trace.head - TRACE_RECORDS)
+        self.lost = 0
+
+    def close(self):
+        self.hal.rtapi_shmem_delete(self.shmem_id, self.comp_id)
+        self.hal.hal_exit(self.comp_id)
+
+    def read(self):
+        """Returns the records written since the previous call.
+
+        The head and the records are read with plain loads, ctypes has no atomic loads or
+        fences. This relies on x86, where loads are not reordered with other loads: the
+        record is copied after `head` has been read, and `head` is read again after the
+        copy. On hosts with a weaker memory model (e.g. ARM) the record could be copied
+        before it is published, hence the reader refuses to run on those hosts.
+        """
+        records = []
+        head = self.trace.head
+        if head - self.tail > TRACE_RECORDS:
+            self.lost += head - TRACE_RECORDS - self.tail
+            self.tail = head - TRACE_RECORDS
+        while self.tail < head:
+            record = TraceRecord.from_buffer_copy(self.trace.records[self.tail % TRACE_RECORDS])
+            # The record may have been overwritten while copying it, when the driver has
+            # reached its slot again
+            if self.trace.head - self.tail >= TRACE_RECORDS:
+                self.lost += 1
+            else:
+                records.append(record)
+            self.tail += 1
+        return records
+
+
+def state_name(status: int) -> str:
+    try:
+        return TooleratorStates(status).name
+    except ValueError:
+        return str(status)
+
+
+def input_names(inputs: int) -> str:
+    return ' '.join(name for bit, name in enumerate(TRACE_INPUTS) if inputs & (1 << bit))
+
+
+class CsvExporter:
+
+    def __init__(self, file):
+        self.writer = csv.writer(file)
+        self.writer.writerow([
+            "time", "board", "instance", "type", "status", "inputs", "tool", "target", 
+            "queue_level", "position", "period"
+        ])
+        self.file = file
+
+    def write(self, record):
+        self.writer.writerow([
+            record.time * 1e-9, 
+            record.board,
+            record.instance,
+            "status" if record.type == TRACE_STATUS else "command",
+            state_name(record.status),
+            input_names(record.inputs),
+            record.tool,
+            record.target,
+            record.queue_level,
+            record.position,
+            record.period
+        ])
+
+    def close(self):
+        self.file.flush()
+
+
+class ChromeTraceExporter:
+    """Writes the records in the Chrome trace event format (JSON array format), which can
+    be opened in chrome://tracing or Perfetto. Each board is a process and each toolerator
+    a thread. The states are shown as slices, the commands as instant events.
+    """
+
+    def __init__(self, file):
+        self.file = file
+        self.file.write("[\n")
+        self.first = True
+        self.states = {}
+
+    def event(self, **kwargs):
+        if not self.first:
+            self.file.write(",\n")
+        self.file.write(json.dumps(kwargs))
+        self.first = False
+
+    def write(self, record):
+        ts = record.time * 1e-3
+        key = (record.board, record.instance)
+        if record.type == TRACE_STATUS:
+            if key in self.states:
+                self.event(name=self.states[key], ph="E", ts=ts, pid=record.board, tid=record.instance)
+            self.states[key] = state_name(record.status)
+            self.event(
+                name=self.states[key], ph="B", ts=ts, pid=record.board, tid=record.instance,
+                args={"tool": record.tool, "target": record.target, "position": record.position}
+            )
+        else:
+            self.event(
+                name="command", ph="i", s="t", ts=ts, pid=record.board, tid=record.instance,
+                args={
+                    "inputs": input_names(record.inputs), "tool_number": record.tool, 
+                    "queue_tool_number": record.target, "queue_level": record.queue_level,
+                    "period": record.period
+                }
+            )
+
+    def close(self):
+        self.file.write("\n]\n")
+        self.file.flush()
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description="Streams the trace of the toolerators to a file, until interrupted. "
+        "Load the driver with `trace=1` to enable the trace."
+    )
+    parser.add_argument("output", help="The file to write the trace to.")
+    parser.add_argument("--format", choices=["csv", "chrome"], default="csv", help="The format of the file.")
+    parser.add_argument("--board", type=int, default=0, help="The index of the board.")
+    parser.add_argument("--interval", type=float, default=0.1, help="Time (in seconds) between reading the trace.")
+    args = parser.parse_args(argv)
+
+    try:
+        reader = TraceReader(args.board)
+    except RuntimeError as error:
+        print(error, file=sys.stderr)
+        return 1
+    with open(args.output, 'w', newline='') as file:
+        exporter = CsvExporter(file) if args.format == "csv" else ChromeTraceExporter(file)
+        try:
+            while True:
+                for record in reader.read():
+                    exporter.write(record)
+                time.sleep(args.interval)
+        except KeyboardInterrupt:
+            pass
+        finally:
+            exporter.close()
+            reader.close()
+    if reader.lost:
+        print(f"{reader.lost} records have been overwritten before these were read.", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())